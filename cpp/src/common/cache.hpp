@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "metrics.hpp"
+
+// Bounded LRU cache split into shards, each with its own lock and its
+// own share of the memory budget, so that threads looking up different
+// keys rarely contend. Sizes are whatever the caller reports for each
+// entry; the cache only adds up and enforces them.
+//
+// Entries expire `ttl` after they were stored; negative ones, which
+// remember that there was nothing to find, after `negative_ttl`.
+template <typename Key, typename Value, typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>>
+class ShardedCache {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    // Identifies the state of a key's shard at a miss, see `put`.
+    using Generation = uint64_t;
+
+    ShardedCache(std::string name, size_t max_bytes, size_t shards,
+                 Clock::duration ttl, Clock::duration negative_ttl)
+        : name(std::move(name)), shards(std::max<size_t>(shards, 1)),
+          shard_bytes(max_bytes / this->shards.size()), ttl(ttl),
+          negative_ttl(negative_ttl) {}
+
+    ShardedCache(const ShardedCache& other) = delete;
+
+    // Looks `key` up. On a miss, `generation` is set for `put`. A hit
+    // copies the value under the shard's lock, so values should be cheap
+    // to copy, such as shared pointers.
+    std::optional<Value> get(const Key& key, Generation& generation) {
+        size_t hash = Hash()(key);
+        Shard& shard = this->shard(hash);
+        std::lock_guard lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            Entry& entry = *it->second;
+            if (Clock::now() < entry.expires) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                (entry.negative ? this->negative_hits : this->hits).add(1);
+                return entry.value;
+            }
+            this->erase(shard, it);
+        }
+        this->misses.add(1);
+        generation = shard.generation;
+        return std::nullopt;
+    }
+
+    // Stores `value`, of `bytes` bytes, under `key`, evicting the least
+    // recently used entries of its shard to make room. Nothing is stored
+    // if the shard was invalidated since the miss that returned
+    // `generation`, as `value` may have been read before the write.
+    void put(const Key& key, Value value, size_t bytes, bool negative,
+             Generation generation) {
+        size_t hash = Hash()(key);
+        Shard& shard = this->shard(hash);
+        // Plus the list and map nodes.
+        bytes += sizeof(Entry) + sizeof(void*) * 4;
+        if (bytes > this->shard_bytes) {
+            return;
+        }
+        std::lock_guard lock(shard.mutex);
+        if (shard.generation != generation) {
+            return;
+        }
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            this->erase(shard, it);
+        }
+        while (shard.bytes + bytes > this->shard_bytes) {
+            this->erase(shard, shard.index.find(shard.lru.back().key));
+            this->evictions.add(1);
+        }
+        shard.lru.push_front(Entry{
+            .key = key,
+            .value = std::move(value),
+            .bytes = bytes,
+            .negative = negative,
+            .expires = Clock::now() + (negative ? this->negative_ttl
+                                                : this->ttl),
+        });
+        shard.index.emplace(key, shard.lru.begin());
+        shard.bytes += bytes;
+        this->entries.fetch_add(1, std::memory_order_relaxed);
+        this->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    // Drops `key`. Reads that missed before this call will not store
+    // their result.
+    void invalidate(const Key& key) {
+        size_t hash = Hash()(key);
+        Shard& shard = this->shard(hash);
+        std::lock_guard lock(shard.mutex);
+        shard.generation++;
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            this->erase(shard, it);
+        }
+        this->invalidations.add(1);
+    }
+
+    CacheStats stats() const {
+        return CacheStats{
+            .name = this->name,
+            .hits = this->hits.load(),
+            .negative_hits = this->negative_hits.load(),
+            .misses = this->misses.load(),
+            .evictions = this->evictions.load(),
+            .invalidations = this->invalidations.load(),
+            .entries = this->entries.load(std::memory_order_relaxed),
+            .bytes = this->bytes.load(std::memory_order_relaxed),
+        };
+    }
+
+  private:
+    struct Entry {
+        Key key;
+        Value value;
+        size_t bytes;
+        bool negative;
+        Clock::time_point expires;
+    };
+
+    using Lru = std::list<Entry>;
+    using Index = std::unordered_map<Key, typename Lru::iterator, Hash, Equal>;
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        // Most recently used first.
+        Lru lru;
+        Index index;
+        size_t bytes = 0;
+        Generation generation = 0;
+    };
+
+    Shard& shard(size_t hash) {
+        // The low bits pick the bucket in the shard's map.
+        return this->shards[(hash >> 16) % this->shards.size()];
+    }
+
+    void erase(Shard& shard, typename Index::iterator it) {
+        size_t bytes = it->second->bytes;
+        shard.bytes -= bytes;
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+        this->entries.fetch_sub(1, std::memory_order_relaxed);
+        this->bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    std::string name;
+    std::vector<Shard> shards;
+    size_t shard_bytes;
+    Clock::duration ttl;
+    Clock::duration negative_ttl;
+
+    ShardedCounter hits;
+    ShardedCounter negative_hits;
+    ShardedCounter misses;
+    ShardedCounter evictions;
+    ShardedCounter invalidations;
+    std::atomic<uint64_t> entries{0};
+    std::atomic<uint64_t> bytes{0};
+};
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <boost/asio/awaitable.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "caching_storage.hpp"
+#include "schema.hpp"
+
+namespace net = boost::asio;
+namespace po = boost::program_options;
+
+// Copies the records of `set` and the strings they view into blocks owned
+// by the result. `bytes` is set to the memory the result holds.
+template <Mapped View>
+static RecordSet<View> own_records(const RecordSet<View>& set,
+                                   size_t& bytes) {
+    auto for_each_string = [](View& record, auto&& f) {
+        for_each_column<View>([&](const auto& column) {
+            using Type = typename std::remove_cvref_t<decltype(column)>::type;
+            if constexpr (std::is_same_v<Type, std::string_view>) {
+                f(record.*column.member);
+            }
+        });
+    };
+
+    std::vector<View> records(set.records.begin(), set.records.end());
+    size_t size = 0;
+    for (View& record : records) {
+        for_each_string(record,
+                        [&](std::string_view& s) { size += s.size(); });
+    }
+    auto block = std::make_shared_for_overwrite<char[]>(size);
+    char* out = block.get();
+    for (View& record : records) {
+        for_each_string(record, [&](std::string_view& s) {
+            if (!s.empty()) {
+                std::memcpy(out, s.data(), s.size());
+            }
+            s = std::string_view(out, s.size());
+            out += s.size();
+        });
+    }
+    bytes = size + records.capacity() * sizeof(View);
+    return make_record_set(std::move(records), std::move(block));
+}
+
+static size_t cache_shards() {
+    return 2 * std::max(1u, std::thread::hardware_concurrency());
+}
+
+CachingStorage::CachingStorage(std::unique_ptr<Storage> backend,
+                               const Config& config)
+    : backend(std::move(backend)),
+      owners("owners", config.max_bytes / 3, cache_shards(), config.ttl,
+             config.negative_ttl),
+      pets("pets", config.max_bytes / 3, cache_shards(), config.ttl,
+           config.negative_ttl),
+      sensors("sensors", config.max_bytes / 3, cache_shards(), config.ttl,
+              config.negative_ttl) {}
+
+template <typename View, typename Read>
+net::awaitable<RecordSet<View>>
+CachingStorage::read_through(Cache<View>& cache, CassUuid key, Read read) {
+    typename Cache<View>::Generation generation;
+    if (std::optional<RecordSet<View>> cached = cache.get(key, generation)) {
+        co_return std::move(*cached);
+    }
+    RecordSet<View> records = co_await read();
+    size_t bytes;
+    RecordSet<View> owned = own_records(records, bytes);
+    cache.put(key, owned, bytes, owned.records.empty(), generation);
+    co_return owned;
+}
+
+net::awaitable<RecordSet<OwnerView>>
+CachingStorage::get_owner(CassUuid owner_id, Deadline deadline) {
+    return this->read_through(
+        this->owners, owner_id, [this, owner_id, deadline] {
+            return this->backend->get_owner(owner_id, deadline);
+        });
+}
+
+net::awaitable<RecordSet<PetView>>
+CachingStorage::get_pets(CassUuid owner_id, Deadline deadline) {
+    return this->read_through(
+        this->pets, owner_id, [this, owner_id, deadline] {
+            return this->backend->get_pets(owner_id, deadline);
+        });
+}
+
+net::awaitable<RecordSet<SensorView>>
+CachingStorage::get_sensors(CassUuid pet_id, Deadline deadline) {
+    return this->read_through(
+        this->sensors, pet_id, [this, pet_id, deadline] {
+            return this->backend->get_sensors(pet_id, deadline);
+        });
+}
+
+std::unique_ptr<MeasurementStream>
+CachingStorage::get_measurements(CassUuid sensor_id, cass_int64_t from,
+                                 cass_int64_t to, StreamDeadline deadline) {
+    return this->backend->get_measurements(sensor_id, from, to, deadline);
+}
+
+net::awaitable<std::vector<std::pair<int32_t, float>>>
+CachingStorage::get_sensor_avg(CassUuid sensor_id,
+                               std::chrono::year_month_day date,
+                               Deadline deadline) {
+    return this->backend->get_sensor_avg(sensor_id, date, deadline);
+}
+
+net::awaitable<void>
+CachingStorage::insert_sensor_avg(CassUuid sensor_id,
+                                  std::chrono::year_month_day date,
+                                  int32_t hour, float value,
+                                  Deadline deadline) {
+    return this->backend->insert_sensor_avg(sensor_id, date, hour, value,
+                                            deadline);
+}
+
+void CachingStorage::insert_owner(const Owner& owner) {
+    this->backend->insert_owner(owner);
+    this->invalidate_owner(owner.id);
+}
+
+void CachingStorage::insert_pet(const Pet& pet) {
+    this->backend->insert_pet(pet);
+    this->invalidate_pets(pet.owner_id);
+}
+
+void CachingStorage::insert_sensor(const Sensor& sensor) {
+    this->backend->insert_sensor(sensor);
+    this->invalidate_sensors(sensor.pet_id);
+}
+
+void CachingStorage::write_measurements(std::vector<Measure> measures,
+                                        WriteCallback done) {
+    this->backend->write_measurements(std::move(measures), std::move(done));
+}
+
+std::vector<StatementStats> CachingStorage::statement_stats() const {
+    return this->backend->statement_stats();
+}
+
+std::vector<CacheStats> CachingStorage::cache_stats() const {
+    std::vector<CacheStats> stats = this->backend->cache_stats();
+    stats.push_back(this->owners.stats());
+    stats.push_back(this->pets.stats());
+    stats.push_back(this->sensors.stats());
+    return stats;
+}
+
+void CachingStorage::invalidate_owner(CassUuid owner_id) {
+    this->owners.invalidate(owner_id);
+}
+
+void CachingStorage::invalidate_pets(CassUuid owner_id) {
+    this->pets.invalidate(owner_id);
+}
+
+void CachingStorage::invalidate_sensors(CassUuid pet_id) {
+    this->sensors.invalidate(pet_id);
+}
+
+std::unique_ptr<Storage> cache_metadata(std::unique_ptr<Storage> storage,
+                                        const po::variables_map& vm) {
+    size_t megabytes = vm["metadata-cache-mb"].as<size_t>();
+    if (megabytes == 0) {
+        return storage;
+    }
+    return std::make_unique<CachingStorage>(
+        std::move(storage),
+        CachingStorage::Config{
+            .max_bytes = megabytes * 1024 * 1024,
+            .ttl = std::chrono::seconds(vm["metadata-cache-ttl-s"].as<int>()),
+            .negative_ttl = std::chrono::seconds(
+                vm["metadata-cache-negative-ttl-s"].as<int>()),
+        });
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "cache.hpp"
+#include "model.hpp"
+#include "storage.hpp"
+
+// `Storage` that keeps the owners, pets and sensors of `backend` in
+// memory and forwards everything else.
+//
+// Metadata is read through one `ShardedCache` per table, keyed by
+// partition key: the owner id for owners and pets, the pet id for
+// sensors. Cached rows are copied into blocks of their own, so they do
+// not pin driver results, and a hit only shares them. Empty results are
+// cached as well, for a shorter time. Writes made through this storage
+// invalidate what they change; writes made by other processes show once
+// the entries expire.
+class CachingStorage : public Storage {
+  public:
+    struct Config {
+        // Memory for cached rows, split evenly between the three tables.
+        size_t max_bytes;
+        std::chrono::seconds ttl;
+        // How long "not found" is remembered.
+        std::chrono::seconds negative_ttl;
+    };
+
+    CachingStorage(std::unique_ptr<Storage> backend, const Config& config);
+
+    boost::asio::awaitable<RecordSet<OwnerView>>
+    get_owner(CassUuid owner_id, Deadline deadline) override;
+
+    boost::asio::awaitable<RecordSet<PetView>>
+    get_pets(CassUuid owner_id, Deadline deadline) override;
+
+    boost::asio::awaitable<RecordSet<SensorView>>
+    get_sensors(CassUuid pet_id, Deadline deadline) override;
+
+    std::unique_ptr<MeasurementStream>
+    get_measurements(CassUuid sensor_id, cass_int64_t from, cass_int64_t to,
+                     StreamDeadline deadline) override;
+
+    boost::asio::awaitable<std::vector<std::pair<int32_t, float>>>
+    get_sensor_avg(CassUuid sensor_id, std::chrono::year_month_day date,
+                   Deadline deadline) override;
+
+    boost::asio::awaitable<void>
+    insert_sensor_avg(CassUuid sensor_id, std::chrono::year_month_day date,
+                      int32_t hour, float value,
+                      Deadline deadline) override;
+
+    void insert_owner(const Owner& owner) override;
+
+    void insert_pet(const Pet& pet) override;
+
+    void insert_sensor(const Sensor& sensor) override;
+
+    void write_measurements(std::vector<Measure> measures,
+                            WriteCallback done) override;
+
+    std::vector<StatementStats> statement_stats() const override;
+
+    std::vector<CacheStats> cache_stats() const override;
+
+    // Invalidation hooks for writes that do not go through this storage.
+    void invalidate_owner(CassUuid owner_id);
+    void invalidate_pets(CassUuid owner_id);
+    void invalidate_sensors(CassUuid pet_id);
+
+  private:
+    template <typename View>
+    using Cache = ShardedCache<CassUuid, RecordSet<View>, UuidHash, UuidEqual>;
+
+    // Returns the entry of `key`, or caches what `read()` returns. `read`
+    // is only called on a miss, so a hit creates no coroutine frame of the
+    // backend; it still creates the one of `read_through`. `read` may run
+    // after the caller returns, so it captures by value.
+    template <typename View, typename Read>
+    boost::asio::awaitable<RecordSet<View>>
+    read_through(Cache<View>& cache, CassUuid key, Read read);
+
+    std::unique_ptr<Storage> backend;
+    Cache<OwnerView> owners;
+    Cache<PetView> pets;
+    Cache<SensorView> sensors;
+};
+
+// Wraps `storage` in a `CachingStorage` as configured by the
+// `--metadata-cache-*` options, or returns it as is if the cache is off.
+std::unique_ptr<Storage>
+cache_metadata(std::unique_ptr<Storage> storage,
+               const boost::program_options::variables_map& vm);
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <array>
+#include <cassandra.h>
+#include <cctype>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "config.hpp"
+
+namespace po = boost::program_options;
+
+static constexpr std::array<std::pair<const char*, CassConsistency>, 11>
+    consistency_names{{
+        {"ANY", CASS_CONSISTENCY_ANY},
+        {"ONE", CASS_CONSISTENCY_ONE},
+        {"TWO", CASS_CONSISTENCY_TWO},
+        {"THREE", CASS_CONSISTENCY_THREE},
+        {"QUORUM", CASS_CONSISTENCY_QUORUM},
+        {"ALL", CASS_CONSISTENCY_ALL},
+        {"LOCAL_QUORUM", CASS_CONSISTENCY_LOCAL_QUORUM},
+        {"EACH_QUORUM", CASS_CONSISTENCY_EACH_QUORUM},
+        {"SERIAL", CASS_CONSISTENCY_SERIAL},
+        {"LOCAL_SERIAL", CASS_CONSISTENCY_LOCAL_SERIAL},
+        {"LOCAL_ONE", CASS_CONSISTENCY_LOCAL_ONE},
+    }};
+
+CassConsistency parse_consistency(const std::string& name) {
+    std::string upper = name;
+    std::transform(upper.begin(), upper.end(), upper.begin(),
+                   [](unsigned char c) { return std::toupper(c); });
+    for (auto [consistency_name, consistency] : consistency_names) {
+        if (upper == consistency_name) {
+            return consistency;
+        }
+    }
+    throw std::invalid_argument("Unknown consistency level: " + name);
+}
+
+po::options_description driver_options() {
+    po::options_description desc("Database driver options");
+    // clang-format off
+    desc.add_options()
+        ("scylla-host", po::value<std::string>()->default_value("127.0.0.1"), "Scylla host (comma separated contact points)")
+        ("page-size", po::value<int>()->default_value(5000), "Rows fetched per page when streaming large results")
+        ("io-threads", po::value<unsigned>()->default_value(1), "Driver I/O threads")
+        ("connections-per-host", po::value<unsigned>()->default_value(1), "Core connections per host")
+        ("connections-per-shard", po::value<unsigned>()->default_value(0), "Core connections per shard (0: driver default)")
+        ("token-aware", po::value<bool>()->default_value(true), "Route requests to a replica owning the partition")
+        ("shard-aware-port-range", po::value<std::string>()->default_value(""), "Local port range MIN-MAX for shard-aware connections")
+        ("request-timeout-ms", po::value<unsigned>()->default_value(12000), "Default request timeout")
+        ("read-consistency", po::value<std::string>()->default_value("LOCAL_ONE"), "Consistency of the 'read' execution profile")
+        ("read-timeout-ms", po::value<unsigned>()->default_value(2000), "Request timeout of the 'read' execution profile")
+        ("read-speculative-delay-ms", po::value<int64_t>()->default_value(0), "Delay before a speculative read is sent (0: disabled)")
+        ("read-speculative-max", po::value<int>()->default_value(2), "Maximum speculative executions of a read")
+        ("write-consistency", po::value<std::string>()->default_value("LOCAL_QUORUM"), "Consistency of the 'write' execution profile")
+        ("write-timeout-ms", po::value<unsigned>()->default_value(5000), "Request timeout of the 'write' execution profile")
+        ("retry-max-attempts", po::value<int>()->default_value(3), "Tries of an idempotent statement before its error is returned")
+        ("retry-backoff-ms", po::value<int64_t>()->default_value(10), "Backoff before the first retry, doubled for every further one")
+        ("retry-backoff-max-ms", po::value<int64_t>()->default_value(200), "Upper bound of the retry backoff")
+        ("hedge-delay-ms", po::value<int64_t>()->default_value(50), "Delay before a slow idempotent read is sent again (0: disabled)");
+    // clang-format on
+    return desc;
+}
+
+DriverConfig driver_config(const po::variables_map& vm) {
+    return DriverConfig{
+        .contact_points = vm["scylla-host"].as<std::string>(),
+        .io_threads = vm["io-threads"].as<unsigned>(),
+        .connections_per_host = vm["connections-per-host"].as<unsigned>(),
+        .connections_per_shard = vm["connections-per-shard"].as<unsigned>(),
+        .token_aware = vm["token-aware"].as<bool>(),
+        .shard_aware_port_range =
+            vm["shard-aware-port-range"].as<std::string>(),
+        .request_timeout_ms = vm["request-timeout-ms"].as<unsigned>(),
+        .page_size = vm["page-size"].as<int>(),
+        .read =
+            {
+                .consistency = parse_consistency(
+                    vm["read-consistency"].as<std::string>()),
+                .request_timeout_ms = vm["read-timeout-ms"].as<unsigned>(),
+                .speculative_delay_ms =
+                    vm["read-speculative-delay-ms"].as<int64_t>(),
+                .speculative_max_executions =
+                    vm["read-speculative-max"].as<int>(),
+            },
+        .write =
+            {
+                .consistency = parse_consistency(
+                    vm["write-consistency"].as<std::string>()),
+                .request_timeout_ms = vm["write-timeout-ms"].as<unsigned>(),
+                .speculative_delay_ms = 0,
+                .speculative_max_executions = 0,
+            },
+        .retry =
+            {
+                .max_attempts = std::max(1, vm["retry-max-attempts"].as<int>()),
+                .backoff = std::chrono::milliseconds(
+                    vm["retry-backoff-ms"].as<int64_t>()),
+                .max_backoff = std::chrono::milliseconds(
+                    vm["retry-backoff-max-ms"].as<int64_t>()),
+                .hedge_delay = std::chrono::milliseconds(
+                    vm["hedge-delay-ms"].as<int64_t>()),
+            },
+    };
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <boost/program_options.hpp>
+#include <cassandra.h>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Names of the execution profiles registered on every cluster.
+namespace profiles {
+// Idempotent lookups: low consistency, short timeout, speculative retries.
+inline constexpr const char* read = "read";
+// Mutations: stronger consistency, no speculative execution.
+inline constexpr const char* write = "write";
+} // namespace profiles
+
+struct ExecutionProfileConfig {
+    CassConsistency consistency;
+    unsigned request_timeout_ms;
+    // Speculative execution is disabled when the delay is 0. The driver
+    // only ever speculates on statements marked idempotent.
+    int64_t speculative_delay_ms;
+    int speculative_max_executions;
+};
+
+// Retries and hedging of statements run against a deadline, on top of
+// what the driver does by itself.
+struct RetryConfig {
+    // Tries of an idempotent statement, including the first one.
+    int max_attempts;
+    // Backoff before the first retry, doubled up to `max_backoff` for
+    // every further one.
+    std::chrono::milliseconds backoff;
+    std::chrono::milliseconds max_backoff;
+    // An idempotent read that has not completed after this long is sent
+    // once more and the first reply wins. 0 disables hedging.
+    std::chrono::milliseconds hedge_delay;
+};
+
+struct DriverConfig {
+    std::string contact_points;
+    unsigned io_threads;
+    unsigned connections_per_host;
+    // 0 leaves the driver default.
+    unsigned connections_per_shard;
+    bool token_aware;
+    // Local port range used to reach the shard-aware port, e.g.
+    // "49152-65535". Empty leaves the driver default.
+    std::string shard_aware_port_range;
+    unsigned request_timeout_ms;
+    int page_size;
+    ExecutionProfileConfig read;
+    ExecutionProfileConfig write;
+    RetryConfig retry;
+};
+
+// Command line (and config file) options consumed by `driver_config`.
+boost::program_options::options_description driver_options();
+
+DriverConfig driver_config(const boost::program_options::variables_map& vm);
+
+CassConsistency parse_consistency(const std::string& name);
@@ -1,7 +1,32 @@
+#include <algorithm>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <atomic>
+#include <cctype>
 #include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <shared_mutex>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
+#include "config.hpp"
 #include "database.hpp"
 #include <cassandra.h>
 
@@ -135,6 +160,25 @@ template <> CassUuid deserialize_cass_value(const CassValue* value) {
     return i;
 }
 
+template <> std::string_view deserialize_cass_value(const CassValue* value) {
+    assert_deser_column_non_null(value);
+    const char* str;
+    size_t len;
+    CassError err = cass_value_get_string(value, &str, &len);
+    assert_deser_success(err, "std::string_view", value);
+    return std::string_view(str, len);
+}
+
+template <>
+std::span<const cass_byte_t> deserialize_cass_value(const CassValue* value) {
+    assert_deser_column_non_null(value);
+    const cass_byte_t* bytes;
+    size_t len;
+    CassError err = cass_value_get_bytes(value, &bytes, &len);
+    assert_deser_success(err, "std::span<const cass_byte_t>", value);
+    return std::span<const cass_byte_t>(bytes, len);
+}
+
 template <> std::string deserialize_cass_value(const CassValue* value) {
     assert_deser_column_non_null(value);
     const char* str;
@@ -145,11 +189,281 @@ template <> std::string deserialize_cass_value(const CassValue* value) {
     return i;
 }
 
+struct Database::PreparedCache {
+    // A query text with the settings it is prepared with. The same text
+    // prepared for another profile is another statement.
+    struct KeyView {
+        std::string_view query;
+        std::string_view profile;
+        bool idempotent;
+
+        bool operator==(const KeyView& other) const = default;
+    };
+
+    struct Key {
+        std::string query;
+        std::string profile;
+        bool idempotent;
+
+        operator KeyView() const {
+            return KeyView{this->query, this->profile, this->idempotent};
+        }
+    };
+
+    struct KeyHash {
+        using is_transparent = void;
+
+        size_t operator()(const KeyView& key) const {
+            size_t hash = std::hash<std::string_view>{}(key.query);
+            hash ^= std::hash<std::string_view>{}(key.profile) +
+                    0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+            return hash ^ size_t(key.idempotent);
+        }
+    };
+
+    struct KeyEqual {
+        using is_transparent = void;
+
+        bool operator()(const KeyView& a, const KeyView& b) const {
+            return a == b;
+        }
+    };
+
+    // A statement that is prepared, or still being prepared by the caller
+    // that inserted the entry. Others wait for it, threads by blocking and
+    // coroutines by suspending, so a query is prepared at most once.
+    struct Entry {
+        // Blocks until the statement is ready. Rethrows the error of a
+        // failed preparation.
+        std::shared_ptr<const PreparedStatement> get() {
+            std::unique_lock lock(this->mutex);
+            this->cv.wait(lock, [this] { return this->ready; });
+            return this->result();
+        }
+
+        // Like `get`, but suspends the calling coroutine instead, which
+        // is resumed on its own executor.
+        boost::asio::awaitable<std::shared_ptr<const PreparedStatement>>
+        co_get() {
+            co_await boost::asio::async_initiate<
+                const boost::asio::use_awaitable_t<>&, void()>(
+                [this](auto handler) {
+                    auto work = boost::asio::make_work_guard(
+                        boost::asio::get_associated_executor(handler));
+                    auto waiter = std::make_shared<
+                        std::pair<decltype(handler), decltype(work)>>(
+                        std::move(handler), std::move(work));
+                    auto resume = [waiter] {
+                        auto executor = waiter->second.get_executor();
+                        boost::asio::post(executor, [waiter] {
+                            std::move(waiter->first)();
+                        });
+                    };
+
+                    std::unique_lock lock(this->mutex);
+                    if (this->ready) {
+                        lock.unlock();
+                        resume();
+                    } else {
+                        this->waiters.push_back(std::move(resume));
+                    }
+                },
+                boost::asio::use_awaitable);
+            std::lock_guard lock(this->mutex);
+            co_return this->result();
+        }
+
+        // Publishes the outcome of the preparation and wakes the waiters.
+        void set(std::shared_ptr<const PreparedStatement> statement,
+                 std::exception_ptr error) {
+            std::vector<std::function<void()>> resume;
+            {
+                std::lock_guard lock(this->mutex);
+                this->statement = std::move(statement);
+                this->error = error;
+                this->ready = true;
+                resume.swap(this->waiters);
+            }
+            this->cv.notify_all();
+            for (auto& waiter : resume) {
+                waiter();
+            }
+        }
+
+      private:
+        std::shared_ptr<const PreparedStatement> result() const {
+            if (this->error) {
+                std::rethrow_exception(this->error);
+            }
+            return this->statement;
+        }
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool ready = false;
+        std::shared_ptr<const PreparedStatement> statement;
+        std::exception_ptr error;
+        std::vector<std::function<void()>> waiters;
+    };
+
+    // Returns the entry of `key`, inserting a pending one if there is
+    // none. `inserted` tells the caller that it has to prepare the
+    // statement and `complete` the entry.
+    std::shared_ptr<Entry> acquire(const KeyView& key, bool& inserted) {
+        {
+            std::shared_lock lock(this->mutex);
+            auto it = this->entries.find(key);
+            if (it != this->entries.end()) {
+                inserted = false;
+                this->hits.fetch_add(1, std::memory_order_relaxed);
+                return it->second;
+            }
+        }
+        std::unique_lock lock(this->mutex);
+        auto [it, is_new] = this->entries.try_emplace(
+            Key{std::string(key.query), std::string(key.profile),
+                key.idempotent});
+        if (is_new) {
+            it->second = std::make_shared<Entry>();
+        }
+        inserted = is_new;
+        (is_new ? this->misses : this->hits)
+            .fetch_add(1, std::memory_order_relaxed);
+        return it->second;
+    }
+
+    // Completes `entry`, the entry of `key`. A failed entry is removed,
+    // so that later callers prepare the statement again; its current
+    // waiters get the error.
+    void complete(const KeyView& key, const std::shared_ptr<Entry>& entry,
+                  std::shared_ptr<const PreparedStatement> statement,
+                  std::exception_ptr error) {
+        if (error) {
+            std::unique_lock lock(this->mutex);
+            auto it = this->entries.find(key);
+            if (it != this->entries.end() && it->second == entry) {
+                this->entries.erase(it);
+            }
+        }
+        entry->set(std::move(statement), error);
+    }
+
+    mutable std::shared_mutex mutex;
+    std::unordered_map<Key, std::shared_ptr<Entry>, KeyHash, KeyEqual>
+        entries;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+};
+
+// Metrics of every prepared query text. Entries are never removed, so
+// statements may keep plain pointers to them.
+struct Database::StatementRegistry {
+    StatementMetrics* get(std::string_view query) {
+        std::lock_guard lock(this->mutex);
+        auto it = this->metrics.find(query);
+        if (it == this->metrics.end()) {
+            it = this->metrics
+                     .emplace(std::string(query),
+                              std::make_unique<StatementMetrics>(
+                                  std::string(query)))
+                     .first;
+        }
+        return it->second.get();
+    }
+
+    mutable std::mutex mutex;
+    std::map<std::string, std::unique_ptr<StatementMetrics>, std::less<>>
+        metrics;
+};
+
+std::vector<StatementStats> Database::statement_stats() const {
+    std::lock_guard lock(this->_statements->mutex);
+    std::vector<StatementStats> stats;
+    for (const auto& [query, metrics] : this->_statements->metrics) {
+        stats.push_back(metrics->stats());
+    }
+    return stats;
+}
+
+static void assert_config_success(CassError error, const char* setting) {
+    if (error != CASS_OK) {
+        throw std::runtime_error(std::format("Invalid driver setting {}: {}",
+                                             setting, cass_error_desc(error)));
+    }
+}
+
+static CassExecProfile*
+new_execution_profile(const ExecutionProfileConfig& config) {
+    CassExecProfile* profile = cass_execution_profile_new();
+    assert_config_success(
+        cass_execution_profile_set_consistency(profile, config.consistency),
+        "consistency");
+    assert_config_success(cass_execution_profile_set_request_timeout(
+                              profile, config.request_timeout_ms),
+                          "request timeout");
+    if (config.speculative_delay_ms > 0) {
+        assert_config_success(
+            cass_execution_profile_set_constant_speculative_execution_policy(
+                profile, config.speculative_delay_ms,
+                config.speculative_max_executions),
+            "speculative execution");
+    }
+    return profile;
+}
+
+static void configure_cluster(CassCluster* cluster,
+                              const DriverConfig& config) {
+    assert_config_success(cass_cluster_set_contact_points(
+                              cluster, config.contact_points.c_str()),
+                          "scylla-host");
+    assert_config_success(
+        cass_cluster_set_num_threads_io(cluster, config.io_threads),
+        "io-threads");
+    assert_config_success(cass_cluster_set_core_connections_per_host(
+                              cluster, config.connections_per_host),
+                          "connections-per-host");
+    if (config.connections_per_shard > 0) {
+        assert_config_success(cass_cluster_set_core_connections_per_shard(
+                                  cluster, config.connections_per_shard),
+                              "connections-per-shard");
+    }
+    cass_cluster_set_token_aware_routing(cluster, config.token_aware);
+    if (!config.shard_aware_port_range.empty()) {
+        int lo, hi;
+        if (std::sscanf(config.shard_aware_port_range.c_str(), "%d-%d", &lo,
+                        &hi) != 2) {
+            throw std::invalid_argument(
+                "shard-aware-port-range should be formatted as MIN-MAX");
+        }
+        assert_config_success(
+            cass_cluster_set_local_port_range(cluster, lo, hi),
+            "shard-aware-port-range");
+    }
+    cass_cluster_set_request_timeout(cluster, config.request_timeout_ms);
+
+    std::pair<const char*, const ExecutionProfileConfig&> profile_configs[] = {
+        {profiles::read, config.read},
+        {profiles::write, config.write},
+    };
+    for (auto [name, profile_config] : profile_configs) {
+        CassExecProfile* profile = new_execution_profile(profile_config);
+        CassError err =
+            cass_cluster_set_execution_profile(cluster, name, profile);
+        // The cluster keeps its own copy.
+        cass_execution_profile_free(profile);
+        assert_config_success(err, name);
+    }
+}
+
 Database::Database(const boost::program_options::variables_map& vm) {
+    DriverConfig config = driver_config(vm);
+    _prepared_cache = std::make_unique<PreparedCache>();
+    _statements = std::make_unique<StatementRegistry>();
     _cluster = cass_cluster_new();
     _session = cass_session_new();
-    std::string host = vm["scylla-host"].as<std::string>();
-    cass_cluster_set_contact_points(_cluster, host.c_str());
+    _page_size = config.page_size;
+    _retry = config.retry;
+    configure_cluster(_cluster, config);
 
     CassFuture* connect_future = cass_session_connect(_session, _cluster);
     if (cass_future_error_code(connect_future) != CASS_OK) {
@@ -160,6 +474,17 @@ Database::Database(const boost::program_options::variables_map& vm) {
     cass_future_free(connect_future);
 }
 
+Database::Database(Database&& other) {
+    this->_cluster = other._cluster;
+    other._cluster = nullptr;
+    this->_session = other._session;
+    other._session = nullptr;
+    this->_prepared_cache = std::move(other._prepared_cache);
+    this->_statements = std::move(other._statements);
+    this->_page_size = other._page_size;
+    this->_retry = other._retry;
+}
+
 Database::~Database() {
     if (_cluster) {
         cass_cluster_free(_cluster);
@@ -169,23 +494,230 @@ Database::~Database() {
     }
 }
 
-QueryResult Database::execute_raw(const CassStatement* statement) {
-    CassFuture* result_future = cass_session_execute(_session, statement);
-    bool success = (cass_future_error_code(result_future) == CASS_OK);
-
-    if (!success) {
-        auto message = future_error_message(result_future);
-        cass_future_free(result_future);
-        throw std::runtime_error(message);
+const CassResult* take_future_result(CassFuture* future,
+                                     std::exception_ptr& error) {
+    const CassResult* result = nullptr;
+    CassError code = cass_future_error_code(future);
+    if (code != CASS_OK) {
+        error = std::make_exception_ptr(
+            QueryError(code, future_error_message(future)));
+    } else {
+        result = cass_future_get_result(future);
     }
+    cass_future_free(future);
+    return result;
+}
 
-    const CassResult* cass_result = cass_future_get_result(result_future);
-    cass_future_free(result_future);
+QueryResult Database::execute_raw(const Statement& statement) {
+    auto started = std::chrono::steady_clock::now();
+    CassFuture* result_future =
+        cass_session_execute(_session, statement.inner);
+    std::exception_ptr error;
+    const CassResult* cass_result = take_future_result(result_future, error);
+    if (statement.metrics) {
+        statement.metrics->record(started, cass_result, statement.bytes);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
 
     return QueryResult(cass_result);
 }
 
-PreparedStatement Database::prepare(const char* query) {
+bool QueryError::transient() const {
+    switch (this->code_) {
+    case CASS_ERROR_LIB_REQUEST_TIMED_OUT:
+    case CASS_ERROR_LIB_NO_HOSTS_AVAILABLE:
+    case CASS_ERROR_LIB_UNABLE_TO_SEND:
+    case CASS_ERROR_SERVER_READ_TIMEOUT:
+    case CASS_ERROR_SERVER_WRITE_TIMEOUT:
+    case CASS_ERROR_SERVER_UNAVAILABLE:
+    case CASS_ERROR_SERVER_OVERLOADED:
+    case CASS_ERROR_SERVER_IS_BOOTSTRAPPING:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool Database::arm(Statement& statement, Deadline deadline) const {
+    if (deadline == no_deadline) {
+        return true;
+    }
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (left.count() <= 0) {
+        if (statement.metrics) {
+            statement.metrics->record_deadline_exceeded();
+        }
+        return false;
+    }
+    cass_statement_set_request_timeout(statement.inner, left.count());
+    return true;
+}
+
+bool Database::hedgeable(const PreparedStatement& statement) const {
+    return statement.idempotent && statement.profile == profiles::read &&
+           this->_retry.hedge_delay.count() > 0;
+}
+
+std::optional<std::chrono::milliseconds>
+Database::retry_backoff(const std::exception_ptr& error, bool idempotent,
+                        int attempt, Deadline deadline) const {
+    if (!idempotent || attempt >= this->_retry.max_attempts) {
+        return std::nullopt;
+    }
+    try {
+        std::rethrow_exception(error);
+    } catch (const QueryError& e) {
+        if (!e.transient()) {
+            return std::nullopt;
+        }
+    } catch (...) {
+        return std::nullopt;
+    }
+
+    // Exponential backoff with jitter, so that requests failed by the
+    // same hiccup do not come back at the same moment.
+    int doublings = std::min(attempt - 1, 20);
+    std::chrono::milliseconds backoff = std::min(
+        this->_retry.backoff * (int64_t(1) << doublings),
+        this->_retry.max_backoff);
+    thread_local std::minstd_rand random(std::random_device{}());
+    backoff = std::chrono::milliseconds(std::uniform_int_distribution<int64_t>(
+        backoff.count() / 2, backoff.count())(random));
+    if (std::chrono::steady_clock::now() + backoff >= deadline) {
+        return std::nullopt;
+    }
+    return backoff;
+}
+
+std::exception_ptr Database::final_error(std::exception_ptr error,
+                                         Deadline deadline,
+                                         StatementMetrics* metrics) const {
+    if (deadline == no_deadline) {
+        return error;
+    }
+    try {
+        std::rethrow_exception(error);
+    } catch (const QueryError& e) {
+        if (!e.transient()) {
+            return error;
+        }
+    } catch (...) {
+        return error;
+    }
+    // Driver timeouts have millisecond resolution, so one armed with the
+    // time left may fire a little before the deadline.
+    if (std::chrono::steady_clock::now() + std::chrono::milliseconds(1) <
+        deadline) {
+        return error;
+    }
+    if (metrics) {
+        metrics->record_deadline_exceeded();
+    }
+    return std::make_exception_ptr(DeadlineExceeded());
+}
+
+void InFlightQuery::send(Database& db, const Statement& statement,
+                         bool hedge) {
+    uint64_t round;
+    {
+        std::lock_guard lock(this->mutex);
+        round = this->round;
+        this->outstanding++;
+        if (hedge) {
+            this->is_hedged = true;
+        } else {
+            this->first_sent = std::chrono::steady_clock::now();
+        }
+    }
+    StatementMetrics* metrics = statement.metrics;
+    if (hedge && metrics) {
+        metrics->record_hedge();
+    }
+    auto deliver = [self = this->shared_from_this(), round, hedge,
+                    metrics](std::exception_ptr error, QueryResult result) {
+        std::function<void()> resume;
+        {
+            std::lock_guard lock(self->mutex);
+            if (self->round != round || self->ready) {
+                return;
+            }
+            self->outstanding--;
+            if (error && self->outstanding > 0) {
+                // Another execution of this round may still succeed.
+                self->error = error;
+                return;
+            }
+            self->error = error;
+            self->result = std::move(result);
+            self->ready = true;
+            resume = std::exchange(self->resume, nullptr);
+        }
+        if (hedge && !error && metrics) {
+            metrics->record_hedge_win();
+        }
+        self->cv.notify_all();
+        if (resume) {
+            resume();
+        }
+    };
+    db.execute_raw_async(statement, std::move(deliver));
+}
+
+std::chrono::steady_clock::time_point InFlightQuery::sent_at() const {
+    std::lock_guard lock(this->mutex);
+    return this->first_sent;
+}
+
+bool InFlightQuery::hedged() const {
+    std::lock_guard lock(this->mutex);
+    return this->is_hedged;
+}
+
+void InFlightQuery::wait() {
+    std::unique_lock lock(this->mutex);
+    this->cv.wait(lock, [this] { return this->ready; });
+}
+
+boost::asio::awaitable<bool>
+InFlightQuery::co_wait_for(std::chrono::steady_clock::duration timeout) {
+    auto executor = co_await boost::asio::this_coro::executor;
+    auto timer = std::make_shared<boost::asio::steady_timer>(executor, timeout);
+    {
+        std::lock_guard lock(this->mutex);
+        if (this->ready) {
+            co_return true;
+        }
+        // Cut the wait short when the reply arrives.
+        this->resume = [executor, timer] {
+            boost::asio::post(executor, [timer] { timer->cancel(); });
+        };
+    }
+    boost::system::error_code ec;
+    co_await timer->async_wait(
+        boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+
+    std::lock_guard lock(this->mutex);
+    this->resume = nullptr;
+    co_return this->ready;
+}
+
+std::pair<std::exception_ptr, QueryResult> InFlightQuery::take() {
+    std::lock_guard lock(this->mutex);
+    std::pair<std::exception_ptr, QueryResult> taken(
+        std::exchange(this->error, nullptr), std::move(this->result));
+    this->result = QueryResult(nullptr);
+    this->round++;
+    this->outstanding = 0;
+    this->ready = false;
+    this->is_hedged = false;
+    return taken;
+}
+
+PreparedStatement Database::prepare(const char* query, std::string profile,
+                                    bool idempotent) {
     CassFuture* fut = cass_session_prepare(this->_session, query);
     bool success = (cass_future_error_code(fut) == CASS_OK);
     if (!success) {
@@ -196,5 +728,165 @@ PreparedStatement Database::prepare(const char* query) {
 
     const CassPrepared* prepared = cass_future_get_prepared(fut);
     cass_future_free(fut);
-    return PreparedStatement(prepared);
+    PreparedStatement statement(prepared, std::move(profile), idempotent);
+    statement.metrics = this->_statements->get(query);
+    return statement;
+}
+
+// Whether `query` is a SELECT, after any leading whitespace and comments.
+static bool is_select(std::string_view query) {
+    for (;;) {
+        size_t start = query.find_first_not_of(" \t\r\n\f\v");
+        query.remove_prefix(std::min(start, query.size()));
+        if (query.starts_with("--") || query.starts_with("//")) {
+            size_t eol = query.find('\n');
+            query.remove_prefix(eol == std::string_view::npos ? query.size()
+                                                              : eol + 1);
+        } else if (query.starts_with("/*")) {
+            size_t end = query.find("*/", 2);
+            if (end == std::string_view::npos) {
+                return false;
+            }
+            query.remove_prefix(end + 2);
+        } else {
+            break;
+        }
+    }
+    std::string_view keyword = "SELECT";
+    return query.size() >= keyword.size() &&
+           std::equal(keyword.begin(), keyword.end(), query.begin(),
+                      [](char k, char c) {
+                          return k == std::toupper((unsigned char)c);
+                      });
+}
+
+std::shared_ptr<const PreparedStatement>
+Database::prepared(std::string_view query) {
+    bool read = is_select(query);
+    return this->prepared(query, read ? profiles::read : profiles::write,
+                          read);
+}
+
+std::shared_ptr<const PreparedStatement>
+Database::prepared(std::string_view query, std::string_view profile,
+                   bool idempotent) {
+    PreparedCache& cache = *this->_prepared_cache;
+    PreparedCache::KeyView key{query, profile, idempotent};
+    bool inserted;
+    std::shared_ptr<PreparedCache::Entry> entry = cache.acquire(key, inserted);
+    if (!inserted) {
+        return entry->get();
+    }
+
+    try {
+        auto statement = std::make_shared<const PreparedStatement>(
+            this->prepare(std::string(query).c_str(), std::string(profile),
+                          idempotent));
+        cache.complete(key, entry, statement, nullptr);
+        return statement;
+    } catch (...) {
+        cache.complete(key, entry, nullptr, std::current_exception());
+        throw;
+    }
+}
+
+// Driver callback of an asynchronous prepare. Owns the future.
+struct PrepareCallback {
+    std::function<void(std::exception_ptr, const CassPrepared*)> callback;
+
+    static void invoke(CassFuture* future, void* data) {
+        std::unique_ptr<PrepareCallback> self(
+            static_cast<PrepareCallback*>(data));
+        std::exception_ptr error;
+        const CassPrepared* prepared = nullptr;
+        if (cass_future_error_code(future) != CASS_OK) {
+            error = std::make_exception_ptr(
+                std::runtime_error(future_error_message(future)));
+        } else {
+            prepared = cass_future_get_prepared(future);
+        }
+        cass_future_free(future);
+        self->callback(error, prepared);
+    }
+};
+
+boost::asio::awaitable<std::shared_ptr<const PreparedStatement>>
+Database::co_prepared(std::string_view query) {
+    // Owned by the frame, since the caller's query may not outlive the
+    // first suspension.
+    std::string text(query);
+    bool read = is_select(text);
+    PreparedCache& cache = *this->_prepared_cache;
+    PreparedCache::KeyView key{text, read ? profiles::read : profiles::write,
+                               read};
+    bool inserted;
+    std::shared_ptr<PreparedCache::Entry> entry = cache.acquire(key, inserted);
+    if (!inserted) {
+        co_return co_await entry->co_get();
+    }
+
+    std::shared_ptr<const PreparedStatement> statement;
+    std::exception_ptr error;
+    try {
+        const CassPrepared* prepared = co_await boost::asio::async_initiate<
+            const boost::asio::use_awaitable_t<>&,
+            void(std::exception_ptr, const CassPrepared*)>(
+            [this, &text](auto handler) {
+                auto work = boost::asio::make_work_guard(
+                    boost::asio::get_associated_executor(handler));
+                auto waiter = std::make_shared<
+                    std::pair<decltype(handler), decltype(work)>>(
+                    std::move(handler), std::move(work));
+                auto data = std::make_unique<PrepareCallback>(PrepareCallback{
+                    .callback = [waiter](std::exception_ptr error,
+                                         const CassPrepared* prepared) {
+                        auto executor = waiter->second.get_executor();
+                        boost::asio::post(executor, [waiter, error, prepared] {
+                            std::move(waiter->first)(error, prepared);
+                        });
+                    },
+                });
+                CassFuture* future = cass_session_prepare_n(
+                    this->_session, text.data(), text.size());
+                CassError err = cass_future_set_callback(
+                    future, &PrepareCallback::invoke, data.get());
+                if (err != CASS_OK) {
+                    cass_future_free(future);
+                    throw std::runtime_error(std::format(
+                        "Failed to set prepare callback. Error: {}",
+                        cass_error_desc(err)));
+                }
+                // Owned by the driver callback from now on.
+                data.release();
+            },
+            boost::asio::use_awaitable);
+
+        PreparedStatement prepared_statement(
+            prepared, std::string(key.profile), read);
+        prepared_statement.metrics = this->_statements->get(text);
+        statement = std::make_shared<const PreparedStatement>(
+            std::move(prepared_statement));
+    } catch (...) {
+        error = std::current_exception();
+    }
+    cache.complete(key, entry, statement, error);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    co_return statement;
+}
+
+CacheStats Database::prepared_cache_stats() const {
+    PreparedCache& cache = *this->_prepared_cache;
+    std::shared_lock lock(cache.mutex);
+    return CacheStats{
+        .name = "prepared_statements",
+        .hits = cache.hits.load(std::memory_order_relaxed),
+        .negative_hits = 0,
+        .misses = cache.misses.load(std::memory_order_relaxed),
+        .evictions = 0,
+        .invalidations = 0,
+        .entries = cache.entries.size(),
+        .bytes = 0,
+    };
 }
@@ -1,19 +1,81 @@
 #pragma once
 
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/core/demangle.hpp>
 #include <boost/program_options.hpp>
 #include <cassandra.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
 #include <format>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <span>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <tuple>
 #include <utility>
+#include <vector>
+
+#include "config.hpp"
+#include "deadline.hpp"
+#include "metrics.hpp"
+#include "schema.hpp"
 
 template <typename T> T deserialize_cass_value(const CassValue* value);
 
+template <typename... Types> class RowStream;
+
+template <typename T>
+CassError bind_to_statement(CassStatement* statement, size_t index,
+                            const T& value);
+
+static inline constexpr void assert_ser_success(CassError error,
+                                                const char* name) {
+    if (error != CASS_OK) {
+        throw std::runtime_error(
+            std::format("Failed to serialize value of type {}. Error: {}",
+                        boost::core::demangle(name), cass_error_desc(error)));
+    }
+}
+
+// Approximate size of the bound values on the wire, for metrics.
+template <typename T> size_t bound_size(const T& value) {
+    if constexpr (requires { value.size(); }) {
+        return value.size();
+    } else {
+        return sizeof(T);
+    }
+}
+
+template <typename... Args>
+void bind_all(CassStatement* statement, const Args&... args) {
+    size_t bind_idx = 0;
+    (assert_ser_success(bind_to_statement(statement, bind_idx++, args),
+                        typeid(args).name()),
+     ...);
+}
+
 class Statement {
   public:
     friend class Database;
+    friend class Batch;
+    friend class PreparedStatement;
+    friend class InFlightQuery;
+    template <typename... Types> friend class RowStream;
 
     Statement(const char* query_str) {
         this->inner = cass_statement_new(query_str, 0);
@@ -21,22 +83,159 @@ class Statement {
 
     Statement(CassStatement* statement) { this->inner = statement; }
 
-    ~Statement() { cass_statement_free(this->inner); }
+    Statement(const Statement& other) = delete;
+
+    Statement(Statement&& other)
+        : metrics(other.metrics), bytes(other.bytes) {
+        this->inner = other.inner;
+        other.inner = nullptr;
+    }
+
+    ~Statement() {
+        if (this->inner) {
+            cass_statement_free(this->inner);
+        }
+    }
+
+    // Binds `args` to the markers of the statement, in order.
+    template <typename... Args> void bind_values(const Args&... args) {
+        bind_all(this->inner, args...);
+        this->bytes += (size_t{0} + ... + bound_size(args));
+    }
 
   private:
     CassStatement* inner;
+    // Where executions are recorded; null for unprepared statements.
+    StatementMetrics* metrics = nullptr;
+    size_t bytes = 0;
 };
 
 class PreparedStatement {
   public:
     friend class Database;
+    friend class Batch;
+
+    // Statements bound from `prepared` run with the named execution
+    // `profile` (see config.hpp), or the cluster defaults when empty.
+    // Only idempotent statements are retried or executed speculatively.
+    PreparedStatement(const CassPrepared* prepared, std::string profile = {},
+                      bool idempotent = false)
+        : profile(std::move(profile)), idempotent(idempotent) {
+        this->inner = prepared;
+    }
+
+    PreparedStatement(const PreparedStatement& other) = delete;
+
+    PreparedStatement(PreparedStatement&& other)
+        : profile(std::move(other.profile)), idempotent(other.idempotent),
+          metrics(other.metrics) {
+        this->inner = other.inner;
+        other.inner = nullptr;
+    }
 
-    PreparedStatement(const CassPrepared* prepared) { this->inner = prepared; }
+    ~PreparedStatement() {
+        if (this->inner) {
+            cass_prepared_free(this->inner);
+        }
+    }
 
-    ~PreparedStatement() { cass_prepared_free(this->inner); }
+    // Creates a new statement for one execution of this one.
+    Statement bind() const {
+        Statement bound(cass_prepared_bind(this->inner));
+        if (!this->profile.empty()) {
+            cass_statement_set_execution_profile(bound.inner,
+                                                 this->profile.c_str());
+        }
+        if (this->idempotent) {
+            cass_statement_set_is_idempotent(bound.inner, cass_true);
+        }
+        bound.metrics = this->metrics;
+        return bound;
+    }
 
   private:
     const CassPrepared* inner;
+    std::string profile;
+    bool idempotent;
+    // Owned by the `Database` that prepared the statement.
+    StatementMetrics* metrics = nullptr;
+};
+
+// Binds the mapped columns of `record` in `Schema` order, matching the
+// markers of `insert_query<Record>()`.
+template <Mapped Record>
+void bind_record(Statement& statement, const Record& record) {
+    std::apply(
+        [&](const auto&... column) {
+            statement.bind_values(record.*(column.member)...);
+        },
+        Schema<Record>::columns);
+}
+
+// A group of statements sent to the cluster in a single request. Unlogged
+// batches whose statements all target one partition are applied as a
+// single mutation, which makes them the cheapest way to write many rows.
+// A batch is recorded as one execution of its first statement.
+class Batch {
+  public:
+    friend class Database;
+
+    Batch(CassBatchType type = CASS_BATCH_TYPE_UNLOGGED,
+          const char* profile = nullptr) {
+        this->inner = cass_batch_new(type);
+        if (profile) {
+            cass_batch_set_execution_profile(this->inner, profile);
+        }
+    }
+
+    Batch(const Batch& other) = delete;
+
+    Batch(Batch&& other)
+        : size(other.size), metrics(other.metrics), bytes(other.bytes) {
+        this->inner = other.inner;
+        other.inner = nullptr;
+    }
+
+    ~Batch() {
+        if (this->inner) {
+            cass_batch_free(this->inner);
+        }
+    }
+
+    template <typename... Args>
+    void add(const PreparedStatement& statement, Args... args) {
+        Statement bound = statement.bind();
+        bound.bind_values(args...);
+        this->add_bound(bound);
+    }
+
+    template <Mapped Record>
+    void add_record(const PreparedStatement& statement, const Record& record) {
+        Statement bound = statement.bind();
+        bind_record(bound, record);
+        this->add_bound(bound);
+    }
+
+    size_t statement_count() const { return this->size; }
+
+  private:
+    void add_bound(const Statement& bound) {
+        CassError err = cass_batch_add_statement(this->inner, bound.inner);
+        if (err != CASS_OK) {
+            throw std::runtime_error(
+                std::format("Failed to add statement to batch. Error: {}",
+                            cass_error_desc(err)));
+        }
+        if (this->size++ == 0) {
+            this->metrics = bound.metrics;
+        }
+        this->bytes += bound.bytes;
+    }
+
+    CassBatch* inner;
+    size_t size = 0;
+    StatementMetrics* metrics = nullptr;
+    size_t bytes = 0;
 };
 
 template <typename... Types, std::size_t... Is>
@@ -46,61 +245,196 @@ static std::tuple<Types...> next_row_impl(const CassRow* row,
         deserialize_cass_value<Types>(cass_row_get_column(row, Is))...);
 }
 
+// Decodes one result row. A list of column types is read into a tuple; a
+// single `Mapped` record type is filled member by member from its
+// `Schema` columns.
+template <typename... Types> struct RowReader {
+    using value_type = std::tuple<Types...>;
+
+    static constexpr size_t column_count = sizeof...(Types);
+
+    static value_type read(const CassRow* row) {
+        return next_row_impl<Types...>(row,
+                                       std::index_sequence_for<Types...>{});
+    }
+};
+
+template <Mapped Record> struct RowReader<Record> {
+    using value_type = Record;
+
+    static constexpr size_t column_count = column_count_v<Record>;
+
+    static value_type read(const CassRow* row) {
+        Record record{};
+        size_t index = 0;
+        for_each_column<Record>([&](const auto& column) {
+            using T = typename std::remove_cvref_t<decltype(column)>::type;
+            record.*(column.member) =
+                deserialize_cass_value<T>(cass_row_get_column(row, index++));
+        });
+        return record;
+    }
+};
+
+// Row cursor over a query result. Besides owning types, columns may be
+// read as `std::string_view` or `std::span<const cass_byte_t>`; those point
+// into the driver's result buffer and stay valid as long as the `Rows` or
+// the `QueryResult` it came from is alive. `Rows<Pet>` yields `Pet`
+// records for a query selecting `column_list<Pet>()`.
 template <typename... Types> class Rows {
   public:
     friend class QueryResult;
 
-    Rows(const CassResult* result) {
-        if (cass_result_column_count(result) != sizeof...(Types)) {
+    using value_type = typename RowReader<Types...>::value_type;
+
+    Rows(std::shared_ptr<const CassResult> result)
+        : result(std::move(result)) {
+        size_t column_count = cass_result_column_count(this->result.get());
+        if (column_count != RowReader<Types...>::column_count) {
             throw std::runtime_error(std::format(
                 "Invalid column count in response expected {} found {}",
-                sizeof...(Types), cass_result_column_count(result)));
+                RowReader<Types...>::column_count, column_count));
         }
-        this->iterator = cass_iterator_from_result(result);
+        this->iterator_ = cass_iterator_from_result(this->result.get());
     }
 
-    ~Rows() { cass_iterator_free(this->iterator); }
+    Rows(const Rows& other) = delete;
+
+    Rows(Rows&& other)
+        : result(std::move(other.result)), iterator_(other.iterator_) {
+        other.iterator_ = nullptr;
+    }
 
-    std::optional<std::tuple<Types...>> next_row() {
-        if (!cass_iterator_next(this->iterator)) {
+    ~Rows() {
+        if (this->iterator_) {
+            cass_iterator_free(this->iterator_);
+        }
+    }
+
+    std::optional<value_type> next_row() {
+        if (!cass_iterator_next(this->iterator_)) {
             return std::nullopt;
         }
-        const CassRow* row = cass_iterator_get_row(this->iterator);
+        const CassRow* row = cass_iterator_get_row(this->iterator_);
 
-        return std::make_optional<std::tuple<Types...>>(
-            next_row_impl<Types...>(row, std::index_sequence_for<Types...>{}));
+        return RowReader<Types...>::read(row);
     }
 
+    // Single-pass input iterator, so a page can be consumed with a
+    // range-based for loop.
+    class iterator {
+      public:
+        using iterator_category = std::input_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = Rows::value_type;
+
+        iterator() = default;
+
+        explicit iterator(Rows* rows) : rows(rows) { ++*this; }
+
+        const value_type& operator*() const { return *this->current; }
+
+        iterator& operator++() {
+            this->current = this->rows->next_row();
+            if (!this->current) {
+                this->rows = nullptr;
+            }
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        friend bool operator==(const iterator& it, std::default_sentinel_t) {
+            return it.rows == nullptr;
+        }
+
+      private:
+        Rows* rows = nullptr;
+        std::optional<value_type> current;
+    };
+
+    iterator begin() { return iterator(this); }
+
+    std::default_sentinel_t end() { return {}; }
+
   private:
-    CassIterator* iterator;
+    std::shared_ptr<const CassResult> result;
+    CassIterator* iterator_ = nullptr;
 };
 
 class QueryResult {
   public:
-    QueryResult(const CassResult* result) { this->inner = result; }
+    template <typename... Types> friend class RowStream;
 
-    template <typename... Types> Rows<Types...> rows() {
+    QueryResult(const CassResult* result) {
+        if (result) {
+            this->inner =
+                std::shared_ptr<const CassResult>(result, cass_result_free);
+        }
+    }
+
+    QueryResult(const QueryResult& other) = delete;
+
+    QueryResult(QueryResult&& other) = default;
+
+    QueryResult& operator=(QueryResult&& other) = default;
+
+    template <typename... Types> Rows<Types...> rows() const {
         return Rows<Types...>(this->inner);
     }
 
-    ~QueryResult() { cass_result_free(this->inner); }
+    // The underlying driver result, for records that view into it.
+    std::shared_ptr<const CassResult> shared() const { return this->inner; }
+
+    bool has_more_pages() const {
+        return cass_result_has_more_pages(this->inner.get());
+    }
 
   private:
-    const CassResult* inner;
+    std::shared_ptr<const CassResult> inner;
 };
 
-static inline constexpr void assert_ser_success(CassError error,
-                                                const char* name) {
-    if (error != CASS_OK) {
-        throw std::runtime_error(
-            std::format("Failed to serialize value of type {}. Error: {}",
-                        boost::core::demangle(name), cass_error_desc(error)));
-    }
-}
+// Error reported by the driver for a failed query.
+class QueryError : public std::runtime_error {
+  public:
+    QueryError(CassError code, const std::string& message)
+        : std::runtime_error(message), code_(code) {}
 
-template <typename T>
-CassError bind_to_statement(CassStatement* statement, size_t index,
-                            const T& value);
+    CassError code() const { return this->code_; }
+
+    // Whether the same query may succeed when sent again: timeouts,
+    // unavailable or overloaded replicas and connection failures.
+    bool transient() const;
+
+  private:
+    CassError code_;
+};
+
+// Takes ownership of a ready `future` and returns its result. On failure
+// returns nullptr and stores a `QueryError` in `error`.
+const CassResult* take_future_result(CassFuture* future,
+                                     std::exception_ptr& error);
+
+// Completion signature of asynchronous queries. `QueryResult` is empty
+// (holds no result) whenever the exception pointer is set.
+using QuerySignature = void(std::exception_ptr, QueryResult);
+
+template <typename Callback> struct QueryCallback {
+    Callback callback;
+    StatementMetrics* metrics;
+    size_t bytes;
+    std::chrono::steady_clock::time_point started;
+
+    static void invoke(CassFuture* future, void* data) {
+        std::unique_ptr<QueryCallback> self(static_cast<QueryCallback*>(data));
+        std::exception_ptr error;
+        const CassResult* result = take_future_result(future, error);
+        if (self->metrics) {
+            self->metrics->record(self->started, result, self->bytes);
+        }
+        std::move(self->callback)(error, QueryResult(result));
+    }
+};
 
 class Database {
   public:
@@ -108,40 +442,604 @@ class Database {
 
     Database(const Database& other) = delete;
 
-    Database(Database&& other) {
-        this->_cluster = other._cluster;
-        other._cluster = nullptr;
-        this->_session = other._session;
-        other._session = nullptr;
-    };
+    Database(Database&& other);
 
     ~Database();
 
     template <typename... Args>
     QueryResult execute(Statement& statement, Args... args) {
-        CassStatement* c_statement = statement.inner;
-        cass_statement_reset_parameters(c_statement, sizeof...(Args));
-        size_t bind_idx = 0;
-        (assert_ser_success(bind_to_statement(c_statement, bind_idx++, args),
-                            typeid(args).name()),
-         ...);
-        return this->execute_raw(c_statement);
+        cass_statement_reset_parameters(statement.inner, sizeof...(Args));
+        statement.bytes = 0;
+        statement.bind_values(args...);
+        return this->execute_raw(statement);
     }
 
-    PreparedStatement prepare(const char* query_str);
+    PreparedStatement prepare(const char* query_str, std::string profile = {},
+                              bool idempotent = false);
+
+    // Returns the shared prepared form of `query`, preparing it on first
+    // use. Thread-safe: concurrent first users wait for a single prepare.
+    // SELECTs, leading whitespace and comments aside, are bound to the
+    // idempotent `read` profile, everything else to the `write` profile.
+    // A first use blocks the calling thread; coroutines use `co_prepared`.
+    std::shared_ptr<const PreparedStatement> prepared(std::string_view query);
+
+    // Like `prepared(query)`, with the execution profile and idempotence
+    // given by the caller instead of derived from the query.
+    std::shared_ptr<const PreparedStatement>
+    prepared(std::string_view query, std::string_view profile,
+             bool idempotent);
+
+    // Like `prepared`, but a first use is prepared through the driver's
+    // callback without blocking the thread, and a coroutine that finds the
+    // query still being prepared is suspended until it is ready.
+    boost::asio::awaitable<std::shared_ptr<const PreparedStatement>>
+    co_prepared(std::string_view query);
+
+    // Lookups and entries of the prepared statement cache, as the
+    // `prepared_statements` cache. Nothing is ever evicted.
+    CacheStats prepared_cache_stats() const;
+
+    // Latency, error, row and byte counts of every statement prepared so
+    // far, ordered by query text. Batches count as one execution of their
+    // first statement; unprepared statements are not recorded.
+    std::vector<StatementStats> statement_stats() const;
+
+    // Query text is executed through the prepared statement cache.
+    template <typename... Args>
+    QueryResult execute(const char* query, Args... args) {
+        return this->execute(*this->prepared(query), args...);
+    }
 
     template <typename... Args>
     QueryResult execute(const PreparedStatement& statement, Args... args) {
-        CassStatement* c_statement = cass_prepared_bind(statement.inner);
-        size_t bind_idx = 0;
-        (assert_ser_success(bind_to_statement(c_statement, bind_idx++, args),
-                            typeid(args).name()),
-         ...);
-        return this->execute_raw(c_statement);
+        Statement bound = statement.bind();
+        bound.bind_values(args...);
+        return this->execute_raw(bound);
+    }
+
+    // Executes `statement` with the mapped columns of `record` as its
+    // arguments, typically an `insert_query<Record>()`.
+    template <Mapped Record>
+    QueryResult execute_record(const PreparedStatement& statement,
+                               const Record& record) {
+        Statement bound = statement.bind();
+        bind_record(bound, record);
+        return this->execute_raw(bound);
+    }
+
+    // Non-blocking variants of `execute`. `callback` is invoked exactly once
+    // as `callback(std::exception_ptr, QueryResult)` on a driver I/O thread,
+    // so it should only hand the result over and must not throw.
+    template <typename Callback, typename... Args>
+    void execute_async(Statement& statement, Callback callback, Args... args) {
+        cass_statement_reset_parameters(statement.inner, sizeof...(Args));
+        statement.bytes = 0;
+        statement.bind_values(args...);
+        this->execute_raw_async(statement, std::move(callback));
+    }
+
+    template <typename Callback, typename... Args>
+    void execute_async(const PreparedStatement& statement, Callback callback,
+                       Args... args) {
+        Statement bound = statement.bind();
+        bound.bind_values(args...);
+        this->execute_raw_async(bound, std::move(callback));
+    }
+
+    template <typename Callback, typename... Args>
+    void execute_async(const char* query, Callback callback, Args... args) {
+        this->execute_async(*this->prepared(query), std::move(callback),
+                            args...);
+    }
+
+    template <typename Callback>
+    void execute_async(const Batch& batch, Callback callback) {
+        this->set_query_callback(
+            cass_session_execute_batch(_session, batch.inner),
+            std::move(callback), batch.metrics, batch.bytes);
+    }
+
+    // Coroutine variants of `execute`. The awaiting coroutine is suspended
+    // while the query is in flight and resumed on its own executor.
+    template <typename... Args>
+    boost::asio::awaitable<QueryResult> co_execute(Statement& statement,
+                                                   Args... args) {
+        cass_statement_reset_parameters(statement.inner, sizeof...(Args));
+        statement.bytes = 0;
+        statement.bind_values(args...);
+        co_return co_await this->async_execute_raw(statement,
+                                                   boost::asio::use_awaitable);
+    }
+
+    template <typename... Args>
+    boost::asio::awaitable<QueryResult>
+    co_execute(const PreparedStatement& statement, Args... args) {
+        Statement bound = statement.bind();
+        bound.bind_values(args...);
+        co_return co_await this->async_execute_raw(bound,
+                                                   boost::asio::use_awaitable);
+    }
+
+    // Runs `statement` so that it completes by `deadline` or throws
+    // `DeadlineExceeded`. Each try gets the time left as its request
+    // timeout. Idempotent statements that fail transiently are retried
+    // with backoff, and hedgeable reads still running after the hedge
+    // delay are sent once more, the first reply winning.
+    template <typename... Args>
+    boost::asio::awaitable<QueryResult>
+    co_execute(Deadline deadline, const PreparedStatement& statement,
+               Args... args);
+
+    template <typename... Args>
+    boost::asio::awaitable<QueryResult> co_execute(const char* query,
+                                                   Args... args) {
+        std::shared_ptr<const PreparedStatement> statement =
+            co_await this->co_prepared(query);
+        co_return co_await this->co_execute(*statement, args...);
+    }
+
+    // Streams the result of `statement` page by page, `page_size` rows at
+    // a time (the `--page-size` option by default). The next page is
+    // requested as soon as the previous one arrives.
+    template <typename... Types, typename... Args>
+    RowStream<Types...> stream(const PreparedStatement& statement,
+                               Args... args);
+
+    template <typename... Types, typename... Args>
+    RowStream<Types...> stream(StreamDeadline deadline,
+                               const PreparedStatement& statement,
+                               Args... args);
+
+    template <typename... Types, typename... Args>
+    RowStream<Types...>
+    stream_with_page_size(int page_size, StreamDeadline deadline,
+                          const PreparedStatement& statement, Args... args);
+
+    // Asio initiating function for an already bound statement. The handler
+    // is posted to its associated executor, never run on a driver thread.
+    template <typename CompletionToken>
+    auto async_execute_raw(const Statement& statement,
+                           CompletionToken&& token) {
+        return boost::asio::async_initiate<CompletionToken, QuerySignature>(
+            [this, &statement](auto handler) {
+                auto work = boost::asio::make_work_guard(
+                    boost::asio::get_associated_executor(handler));
+                this->execute_raw_async(
+                    statement,
+                    [handler = std::move(handler), work = std::move(work)](
+                        std::exception_ptr error, QueryResult result) mutable {
+                        auto executor = work.get_executor();
+                        boost::asio::post(
+                            executor,
+                            [handler = std::move(handler), error,
+                             result = std::move(result)]() mutable {
+                                std::move(handler)(error, std::move(result));
+                            });
+                    });
+            },
+            token);
+    }
+
+    template <typename Callback>
+    void execute_raw_async(const Statement& statement, Callback callback) {
+        this->set_query_callback(
+            cass_session_execute(_session, statement.inner),
+            std::move(callback), statement.metrics, statement.bytes);
     }
 
   private:
-    QueryResult execute_raw(const CassStatement* statement);
+    template <typename... Types> friend class RowStream;
+
+    // Sets the request timeout of `statement` to the time left until
+    // `deadline`. Returns false if there is none left.
+    bool arm(Statement& statement, Deadline deadline) const;
+
+    // Whether reads of `statement` may be hedged.
+    bool hedgeable(const PreparedStatement& statement) const;
+
+    // Backoff before try `attempt + 1` after `error`, or nothing if the
+    // statement must not or cannot be retried before `deadline`.
+    std::optional<std::chrono::milliseconds>
+    retry_backoff(const std::exception_ptr& error, bool idempotent,
+                  int attempt, Deadline deadline) const;
+
+    // The error to report for `error`, a failure that will not be retried.
+    // A transient error that arrives once `deadline` has passed, usually
+    // the driver's timeout set by `arm`, is the deadline running out and
+    // becomes `DeadlineExceeded`, recorded in `metrics`.
+    std::exception_ptr final_error(std::exception_ptr error,
+                                   Deadline deadline,
+                                   StatementMetrics* metrics) const;
+
+    template <typename Callback>
+    void set_query_callback(CassFuture* future, Callback callback,
+                            StatementMetrics* metrics, size_t bytes) {
+        auto data = std::make_unique<QueryCallback<Callback>>(
+            QueryCallback<Callback>{
+                .callback = std::move(callback),
+                .metrics = metrics,
+                .bytes = bytes,
+                .started = std::chrono::steady_clock::now(),
+            });
+        CassError err = cass_future_set_callback(
+            future, &QueryCallback<Callback>::invoke, data.get());
+        if (err != CASS_OK) {
+            cass_future_free(future);
+            throw std::runtime_error(std::format(
+                "Failed to set query callback. Error: {}",
+                cass_error_desc(err)));
+        }
+        // Owned by the driver callback from now on.
+        data.release();
+    }
+
+    struct PreparedCache;
+    struct StatementRegistry;
+
+    QueryResult execute_raw(const Statement& statement);
     CassCluster* _cluster = nullptr;
     CassSession* _session = nullptr;
+    std::unique_ptr<PreparedCache> _prepared_cache;
+    std::unique_ptr<StatementRegistry> _statements;
+    int _page_size = 5000;
+    RetryConfig _retry{};
 };
+
+// Result slot shared by the executions of one request while it is retried
+// or hedged. The executions sent in one round race to fill the slot: the
+// first reply wins, later ones are dropped, and an error only wins once
+// no other execution of the round is left. Driver callbacks keep the
+// slot alive, so it may outlive its owner.
+class InFlightQuery : public std::enable_shared_from_this<InFlightQuery> {
+  public:
+    // Sends `statement` in the current round. A `hedge` duplicates an
+    // execution that is already in flight.
+    void send(Database& db, const Statement& statement, bool hedge = false);
+
+    // When the first execution of the current round was sent.
+    std::chrono::steady_clock::time_point sent_at() const;
+
+    bool hedged() const;
+
+    // Blocks until the current round has a result.
+    void wait();
+
+    // Waits at most `timeout` for the current round. Returns whether it
+    // has a result.
+    boost::asio::awaitable<bool>
+    co_wait_for(std::chrono::steady_clock::duration timeout);
+
+    // Completes on the handler's executor once the current round has a
+    // result.
+    template <typename CompletionToken>
+    auto async_wait(CompletionToken&& token) {
+        return boost::asio::async_initiate<CompletionToken, void()>(
+            [self = this->shared_from_this()](auto handler) {
+                auto work = boost::asio::make_work_guard(
+                    boost::asio::get_associated_executor(handler));
+                auto waiter = std::make_shared<
+                    std::pair<decltype(handler), decltype(work)>>(
+                    std::move(handler), std::move(work));
+                auto resume = [waiter] {
+                    auto executor = waiter->second.get_executor();
+                    boost::asio::post(executor,
+                                      [waiter] { std::move(waiter->first)(); });
+                };
+
+                std::unique_lock lock(self->mutex);
+                if (self->ready) {
+                    lock.unlock();
+                    resume();
+                } else {
+                    self->resume = std::move(resume);
+                }
+            },
+            token);
+    }
+
+    // Takes the result of the current round and starts the next one.
+    std::pair<std::exception_ptr, QueryResult> take();
+
+  private:
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    uint64_t round = 0;
+    int outstanding = 0;
+    bool ready = false;
+    bool is_hedged = false;
+    std::chrono::steady_clock::time_point first_sent;
+    std::exception_ptr error;
+    QueryResult result{nullptr};
+    std::function<void()> resume;
+};
+
+template <typename... Args>
+boost::asio::awaitable<QueryResult>
+Database::co_execute(Deadline deadline, const PreparedStatement& statement,
+                     Args... args) {
+    auto query = std::make_shared<InFlightQuery>();
+    bool hedge = this->hedgeable(statement);
+    for (int attempt = 1;; attempt++) {
+        Statement bound = statement.bind();
+        bound.bind_values(args...);
+        if (!this->arm(bound, deadline)) {
+            throw DeadlineExceeded();
+        }
+        query->send(*this, bound);
+        if (hedge && std::chrono::steady_clock::now() +
+                             this->_retry.hedge_delay <
+                         deadline) {
+            if (!co_await query->co_wait_for(this->_retry.hedge_delay)) {
+                query->send(*this, bound, true);
+            }
+        }
+        co_await query->async_wait(boost::asio::use_awaitable);
+
+        auto [error, result] = query->take();
+        if (!error) {
+            co_return std::move(result);
+        }
+        std::optional<std::chrono::milliseconds> backoff = this->retry_backoff(
+            error, statement.idempotent, attempt, deadline);
+        if (!backoff) {
+            std::rethrow_exception(
+                this->final_error(error, deadline, bound.metrics));
+        }
+        if (bound.metrics) {
+            bound.metrics->record_retry();
+        }
+        boost::asio::steady_timer timer(
+            co_await boost::asio::this_coro::executor, *backoff);
+        co_await timer.async_wait(boost::asio::use_awaitable);
+    }
+}
+
+// Result of a query consumed page by page in constant memory.
+//
+// While one page is being read the next one is already in flight. Pages
+// can be awaited from a coroutine:
+//
+//     while (co_await stream.co_next_page()) {
+//         for (auto [ts, value] : stream.page()) { ... }
+//     }
+//
+// or the whole stream can be iterated as one input range, which blocks
+// the calling thread whenever the next page has not arrived yet:
+//
+//     for (auto [ts, value] : stream) { ... }
+//
+// Every page fetch gets the time left until its deadline, see
+// `StreamDeadline`; retries of a page keep the deadline of its first
+// fetch. Failed fetches of idempotent statements are retried, and while a
+// coroutine waits for a slow page of a hedgeable read the fetch is sent a
+// second time.
+//
+// Each execution gets a statement of its own from `bind`, since the
+// driver may still be sending the ones of earlier executions.
+template <typename... Types> class RowStream {
+  public:
+    RowStream(Database& db, std::function<Statement()> bind, int page_size,
+              StreamDeadline deadlines, bool idempotent, bool hedge)
+        : db(db), bind(std::move(bind)), page_size(page_size),
+          query(std::make_shared<InFlightQuery>()), deadlines(deadlines),
+          deadline(deadlines.page(true)), idempotent(idempotent),
+          hedge(hedge) {
+        this->fetch();
+    }
+
+    RowStream(const RowStream& other) = delete;
+
+    RowStream(RowStream&& other) = default;
+
+    // Waits for the next page and makes it current. Returns false once
+    // the result is exhausted and rethrows query errors.
+    bool next_page() {
+        if (!this->fetching) {
+            return false;
+        }
+        for (int attempt = 1;; attempt++) {
+            this->check_deadline();
+            this->query->wait();
+            if (this->take_page(attempt)) {
+                return true;
+            }
+            std::this_thread::sleep_for(this->backoff);
+            this->fetch();
+        }
+    }
+
+    boost::asio::awaitable<bool> co_next_page() {
+        if (!this->fetching) {
+            co_return false;
+        }
+        for (int attempt = 1;; attempt++) {
+            this->check_deadline();
+            auto hedge_at =
+                this->query->sent_at() + this->db._retry.hedge_delay;
+            if (this->hedge && !this->query->hedged() &&
+                hedge_at < this->deadline) {
+                if (!co_await this->query->co_wait_for(
+                        hedge_at - std::chrono::steady_clock::now())) {
+                    if (std::optional<Statement> statement =
+                            this->next_statement()) {
+                        this->query->send(this->db, *statement, true);
+                    }
+                }
+            }
+            co_await this->query->async_wait(boost::asio::use_awaitable);
+            if (this->take_page(attempt)) {
+                co_return true;
+            }
+            boost::asio::steady_timer timer(
+                co_await boost::asio::this_coro::executor, this->backoff);
+            co_await timer.async_wait(boost::asio::use_awaitable);
+            this->fetch();
+        }
+    }
+
+    Rows<Types...>& page() { return *this->current; }
+
+    uint64_t pages_fetched() const { return this->pages; }
+
+    class iterator {
+      public:
+        using iterator_category = std::input_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = typename Rows<Types...>::value_type;
+
+        iterator() = default;
+
+        explicit iterator(RowStream* stream) : stream(stream) { ++*this; }
+
+        const value_type& operator*() const { return *this->current; }
+
+        iterator& operator++() {
+            for (;;) {
+                if (this->stream->current) {
+                    this->current = this->stream->current->next_row();
+                    if (this->current) {
+                        return *this;
+                    }
+                }
+                if (!this->stream->next_page()) {
+                    this->stream = nullptr;
+                    return *this;
+                }
+            }
+        }
+
+        void operator++(int) { ++*this; }
+
+        friend bool operator==(const iterator& it, std::default_sentinel_t) {
+            return it.stream == nullptr;
+        }
+
+      private:
+        RowStream* stream = nullptr;
+        std::optional<value_type> current;
+    };
+
+    iterator begin() { return iterator(this); }
+
+    std::default_sentinel_t end() { return {}; }
+
+  private:
+    // A statement for the page after the current one, or nothing if the
+    // deadline has passed.
+    std::optional<Statement> next_statement() {
+        Statement statement = this->bind();
+        cass_statement_set_paging_size(statement.inner, this->page_size);
+        if (!this->paging_state.empty()) {
+            cass_statement_set_paging_state_token(statement.inner,
+                                                  this->paging_state.data(),
+                                                  this->paging_state.size());
+        }
+        if (!this->db.arm(statement, this->deadline)) {
+            return std::nullopt;
+        }
+        return statement;
+    }
+
+    void fetch() {
+        this->fetching = true;
+        // A page requested after the deadline is reported by the next
+        // wait rather than here, where a page may still be unread.
+        std::optional<Statement> statement = this->next_statement();
+        this->expired = !statement;
+        if (statement) {
+            this->metrics = statement->metrics;
+            this->query->send(this->db, *statement);
+        }
+    }
+
+    void check_deadline() {
+        if (this->expired) {
+            this->fetching = false;
+            throw DeadlineExceeded();
+        }
+    }
+
+    // Makes the arrived page current and requests the one after it.
+    // Returns false if the fetch failed and should be retried after
+    // `backoff`.
+    bool take_page(int attempt) {
+        auto [error, result] = this->query->take();
+        if (error) {
+            std::optional<std::chrono::milliseconds> backoff =
+                this->db.retry_backoff(error, this->idempotent, attempt,
+                                       this->deadline);
+            if (!backoff) {
+                this->fetching = false;
+                std::rethrow_exception(this->db.final_error(
+                    error, this->deadline, this->metrics));
+            }
+            if (this->metrics) {
+                this->metrics->record_retry();
+            }
+            this->backoff = *backoff;
+            return false;
+        }
+        this->pages++;
+        this->current.emplace(result.inner);
+        this->fetching = false;
+        if (result.has_more_pages()) {
+            const char* token;
+            size_t size;
+            cass_result_paging_state_token(result.inner.get(), &token, &size);
+            this->paging_state.assign(token, size);
+            this->deadline = this->deadlines.page(false);
+            this->fetch();
+        }
+        return true;
+    }
+
+    Database& db;
+    std::function<Statement()> bind;
+    int page_size;
+    // Where the next page starts; empty for the first.
+    std::string paging_state;
+    StatementMetrics* metrics = nullptr;
+    std::shared_ptr<InFlightQuery> query;
+    StreamDeadline deadlines;
+    // Deadline of the page being fetched.
+    Deadline deadline;
+    bool idempotent;
+    bool hedge;
+    std::optional<Rows<Types...>> current;
+    bool fetching = false;
+    bool expired = false;
+    std::chrono::milliseconds backoff{0};
+    uint64_t pages = 0;
+};
+
+template <typename... Types, typename... Args>
+RowStream<Types...> Database::stream(const PreparedStatement& statement,
+                                     Args... args) {
+    return this->stream_with_page_size<Types...>(
+        this->_page_size, no_deadline, statement, args...);
+}
+
+template <typename... Types, typename... Args>
+RowStream<Types...> Database::stream(StreamDeadline deadline,
+                                     const PreparedStatement& statement,
+                                     Args... args) {
+    return this->stream_with_page_size<Types...>(this->_page_size, deadline,
+                                                 statement, args...);
+}
+
+template <typename... Types, typename... Args>
+RowStream<Types...>
+Database::stream_with_page_size(int page_size, StreamDeadline deadline,
+                                const PreparedStatement& statement,
+                                Args... args) {
+    // Outlives the stream like the rest of the prepared statements.
+    auto bind = [&statement, ... args = args] {
+        Statement bound = statement.bind();
+        bound.bind_values(args...);
+        return bound;
+    };
+    return RowStream<Types...>(*this, std::move(bind), page_size, deadline,
+                               statement.idempotent,
+                               this->hedgeable(statement));
+}
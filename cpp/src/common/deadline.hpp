@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <stdexcept>
+
+// Point in time by which a request has to be answered. The HTTP layer
+// sets one per request and passes it down to every query made for it.
+using Deadline = std::chrono::steady_clock::time_point;
+
+// Deadline of work that may take as long as it needs.
+inline constexpr Deadline no_deadline = Deadline::max();
+
+// Deadlines of a result read page by page. The first page is due by
+// `first`. Every later page is due `page_timeout` after it is requested,
+// so that reading a wide result is not cut short by the deadline of the
+// request that started it; a zero `page_timeout` holds every page to
+// `first` instead.
+struct StreamDeadline {
+    StreamDeadline(Deadline first,
+                   std::chrono::milliseconds page_timeout = {})
+        : first(first), page_timeout(page_timeout) {}
+
+    // Deadline of a page requested now.
+    Deadline page(bool first_page) const {
+        if (first_page || this->page_timeout.count() <= 0) {
+            return this->first;
+        }
+        return std::chrono::steady_clock::now() + this->page_timeout;
+    }
+
+    Deadline first;
+    std::chrono::milliseconds page_timeout;
+};
+
+// Thrown when a deadline passes before the work is done.
+class DeadlineExceeded : public std::runtime_error {
+  public:
+    DeadlineExceeded() : std::runtime_error("Deadline exceeded") {}
+};
@@ -1,4 +1,5 @@
 #include "json.hpp"
+#include "metrics.hpp"
 #include "model.hpp"
 #include <boost/json.hpp>
 #include <cassandra.h>
@@ -6,13 +7,15 @@
 namespace boost {
 namespace json {
 
-void tag_invoke(value_from_tag, value& jv, const Owner& o) {
+// Owning and view records share the conversion code.
+
+template <typename O> static void owner_to_json(value& jv, const O& o) {
     char id_str[CASS_UUID_STRING_LENGTH];
     cass_uuid_string(o.id, id_str);
     jv = {{"id", id_str}, {"name", o.name}, {"address", o.address}};
 }
 
-void tag_invoke(value_from_tag, value& jv, const Pet& p) {
+template <typename P> static void pet_to_json(value& jv, const P& p) {
     char owner_id_str[CASS_UUID_STRING_LENGTH];
     cass_uuid_string(p.owner_id, owner_id_str);
     char pet_id_str[CASS_UUID_STRING_LENGTH];
@@ -24,7 +27,7 @@ void tag_invoke(value_from_tag, value& jv, const Pet& p) {
         {"address", p.address},     {"name", p.name}};
 }
 
-void tag_invoke(value_from_tag, value& jv, const Sensor& s) {
+template <typename S> static void sensor_to_json(value& jv, const S& s) {
     char pet_id_str[CASS_UUID_STRING_LENGTH];
     cass_uuid_string(s.pet_id, pet_id_str);
     char sensor_id_str[CASS_UUID_STRING_LENGTH];
@@ -32,6 +35,28 @@ void tag_invoke(value_from_tag, value& jv, const Sensor& s) {
     jv = {{"pet_id", pet_id_str}, {"id", sensor_id_str}, {"type", s.type}};
 }
 
+void tag_invoke(value_from_tag, value& jv, const Owner& o) {
+    owner_to_json(jv, o);
+}
+
+void tag_invoke(value_from_tag, value& jv, const OwnerView& o) {
+    owner_to_json(jv, o);
+}
+
+void tag_invoke(value_from_tag, value& jv, const Pet& p) { pet_to_json(jv, p); }
+
+void tag_invoke(value_from_tag, value& jv, const PetView& p) {
+    pet_to_json(jv, p);
+}
+
+void tag_invoke(value_from_tag, value& jv, const Sensor& s) {
+    sensor_to_json(jv, s);
+}
+
+void tag_invoke(value_from_tag, value& jv, const SensorView& s) {
+    sensor_to_json(jv, s);
+}
+
 void tag_invoke(value_from_tag, value& jv, const Measure& m) {
     char sensor_id_str[CASS_UUID_STRING_LENGTH];
     cass_uuid_string(m.sensor_id, sensor_id_str);
@@ -52,5 +77,24 @@ void tag_invoke(value_from_tag, value& jv, const SensorAvg& sa) {
     };
 }
 
+void tag_invoke(value_from_tag, value& jv, const StatementStats& st) {
+    jv = {
+        {"query", st.query},
+        {"executions", st.executions},
+        {"errors", st.errors},
+        {"rows", st.rows},
+        {"bytes", st.bytes},
+        {"retries", st.retries},
+        {"hedges", st.hedges},
+        {"hedge_wins", st.hedge_wins},
+        {"deadlines_exceeded", st.deadlines_exceeded},
+        {"latency_us",
+         {{"p50", st.latency.p50.count()},
+          {"p99", st.latency.p99.count()},
+          {"p999", st.latency.p999.count()},
+          {"max", st.latency.max.count()}}},
+    };
+}
+
 } // namespace json
 } // namespace boost
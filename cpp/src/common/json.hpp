@@ -1,5 +1,6 @@
 #pragma once
 
+#include "metrics.hpp"
 #include "model.hpp"
 #include <boost/json.hpp>
 #include <cassandra.h>
@@ -12,6 +13,10 @@ void tag_invoke(value_from_tag, value& jv, const Pet& p);
 void tag_invoke(value_from_tag, value& jv, const Sensor& s);
 void tag_invoke(value_from_tag, value& jv, const Measure& m);
 void tag_invoke(value_from_tag, value& jv, const SensorAvg& sa);
+void tag_invoke(value_from_tag, value& jv, const OwnerView& o);
+void tag_invoke(value_from_tag, value& jv, const PetView& p);
+void tag_invoke(value_from_tag, value& jv, const SensorView& s);
+void tag_invoke(value_from_tag, value& jv, const StatementStats& st);
 
 } // namespace json
 } // namespace boost
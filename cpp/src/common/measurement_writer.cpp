@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "measurement_writer.hpp"
+#include "model.hpp"
+#include "storage.hpp"
+
+MeasurementWriter::MeasurementWriter(Storage& storage, size_t batch_size,
+                                     size_t max_in_flight,
+                                     std::chrono::milliseconds flush_interval)
+    : storage(storage), batch_size(std::max<size_t>(1, batch_size)),
+      max_in_flight(std::max<size_t>(1, max_in_flight)),
+      flush_interval(flush_interval), started_at(Clock::now()) {
+    this->timer = std::thread([this] { this->run_timer(); });
+}
+
+MeasurementWriter::~MeasurementWriter() {
+    try {
+        this->close();
+    } catch (...) {
+        // Errors are only reported to callers of `close`.
+    }
+}
+
+void MeasurementWriter::add(const Measure& measure) {
+    std::unique_lock lock(this->mutex);
+    this->rethrow_error_locked();
+    if (this->closed) {
+        throw std::logic_error("MeasurementWriter is already closed");
+    }
+
+    std::vector<Measure>& partition = this->pending[measure.sensor_id];
+    partition.push_back(measure);
+    if (partition.size() >= this->batch_size) {
+        std::vector<Measure> measures = std::move(partition);
+        this->pending.erase(measure.sensor_id);
+        this->send(lock, std::move(measures));
+    }
+}
+
+void MeasurementWriter::flush() {
+    std::unique_lock lock(this->mutex);
+    this->flush_locked(lock);
+    this->rethrow_error_locked();
+}
+
+void MeasurementWriter::close() {
+    std::unique_lock lock(this->mutex);
+    if (!this->closed) {
+        this->flush_locked(lock);
+        this->closed = true;
+        this->timer_cv.notify_all();
+        this->window_cv.wait(lock, [this] { return this->in_flight == 0; });
+
+        lock.unlock();
+        this->timer.join();
+        lock.lock();
+    }
+    this->rethrow_error_locked();
+}
+
+MeasurementWriter::Stats MeasurementWriter::stats() const {
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    std::lock_guard lock(this->mutex);
+    Stats stats{.rows = this->rows_written,
+                .batches = this->batches_written,
+                .errors = this->errors};
+
+    std::chrono::duration<double> elapsed = Clock::now() - this->started_at;
+    if (elapsed.count() > 0) {
+        stats.rows_per_second = this->rows_written / elapsed.count();
+    }
+    if (this->batches_written > 0) {
+        stats.avg_flush_latency = duration_cast<microseconds>(
+            this->total_flush_latency / this->batches_written);
+    }
+    stats.max_flush_latency =
+        duration_cast<microseconds>(this->max_flush_latency);
+    return stats;
+}
+
+void MeasurementWriter::send(std::unique_lock<std::mutex>& lock,
+                             std::vector<Measure> measures) {
+    // Backpressure: wait for a free slot in the window.
+    this->window_cv.wait(
+        lock, [this] { return this->in_flight < this->max_in_flight; });
+    this->in_flight++;
+
+    // The callback takes the lock, and the storage may run it inline, so
+    // the rows are written without the lock.
+    lock.unlock();
+    size_t rows = measures.size();
+    Clock::time_point started = Clock::now();
+    try {
+        this->storage.write_measurements(
+            std::move(measures),
+            [this, rows, started](std::exception_ptr error) {
+                this->on_batch_done(error, rows, started);
+            });
+    } catch (...) {
+        this->on_batch_done(std::current_exception(), rows, started);
+    }
+    lock.lock();
+}
+
+void MeasurementWriter::flush_locked(std::unique_lock<std::mutex>& lock) {
+    auto pending = std::move(this->pending);
+    this->pending.clear();
+    for (auto& [sensor_id, measures] : pending) {
+        this->send(lock, std::move(measures));
+    }
+}
+
+void MeasurementWriter::on_batch_done(std::exception_ptr error, size_t rows,
+                                      Clock::time_point started) {
+    Clock::duration latency = Clock::now() - started;
+
+    std::lock_guard lock(this->mutex);
+    this->in_flight--;
+    if (error) {
+        this->errors++;
+        if (!this->first_error) {
+            this->first_error = error;
+        }
+    } else {
+        this->rows_written += rows;
+        this->batches_written++;
+        this->total_flush_latency += latency;
+        this->max_flush_latency = std::max(this->max_flush_latency, latency);
+    }
+    this->window_cv.notify_all();
+}
+
+void MeasurementWriter::rethrow_error_locked() {
+    if (this->first_error) {
+        std::rethrow_exception(std::exchange(this->first_error, nullptr));
+    }
+}
+
+void MeasurementWriter::run_timer() {
+    std::unique_lock lock(this->mutex);
+    while (!this->closed) {
+        this->timer_cv.wait_for(lock, this->flush_interval);
+        if (!this->closed) {
+            this->flush_locked(lock);
+        }
+    }
+}
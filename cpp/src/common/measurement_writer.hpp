@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "model.hpp"
+#include "storage.hpp"
+
+// Buffers measurements and writes them to a `Storage` in per-partition
+// groups; the ScyllaDB backend sends each group as an unlogged
+// single-partition batch.
+//
+// Rows are grouped by `sensor_id`. A partition is sent as soon as it holds
+// `batch_size` rows, and everything that is still buffered is sent every
+// `flush_interval`. At most `max_in_flight` batches are outstanding at once;
+// `add` blocks while that window is full, so a producer can never outrun
+// the cluster by more than the window.
+//
+// Write errors are reported by rethrowing the first one from the next call
+// to `add`, `flush` or `close`.
+class MeasurementWriter {
+  public:
+    struct Stats {
+        uint64_t rows = 0;
+        uint64_t batches = 0;
+        uint64_t errors = 0;
+        double rows_per_second = 0.0;
+        std::chrono::microseconds avg_flush_latency{0};
+        std::chrono::microseconds max_flush_latency{0};
+    };
+
+    MeasurementWriter(Storage& storage, size_t batch_size,
+                      size_t max_in_flight,
+                      std::chrono::milliseconds flush_interval);
+
+    MeasurementWriter(const MeasurementWriter& other) = delete;
+
+    ~MeasurementWriter();
+
+    void add(const Measure& measure);
+
+    // Sends all buffered rows without waiting for them to be written.
+    void flush();
+
+    // Sends all buffered rows and waits until every batch has completed.
+    void close();
+
+    Stats stats() const;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    void send(std::unique_lock<std::mutex>& lock,
+              std::vector<Measure> measures);
+    void flush_locked(std::unique_lock<std::mutex>& lock);
+    void on_batch_done(std::exception_ptr error, size_t rows,
+                       Clock::time_point started);
+    void rethrow_error_locked();
+    void run_timer();
+
+    Storage& storage;
+    const size_t batch_size;
+    const size_t max_in_flight;
+    const std::chrono::milliseconds flush_interval;
+
+    mutable std::mutex mutex;
+    std::condition_variable window_cv;
+    std::condition_variable timer_cv;
+    std::map<CassUuid, std::vector<Measure>, UuidLess> pending;
+    size_t in_flight = 0;
+    bool closed = false;
+    std::exception_ptr first_error;
+
+    Clock::time_point started_at;
+    uint64_t rows_written = 0;
+    uint64_t batches_written = 0;
+    uint64_t errors = 0;
+    Clock::duration total_flush_latency{0};
+    Clock::duration max_flush_latency{0};
+
+    std::thread timer;
+};
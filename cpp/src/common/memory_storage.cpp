@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <format>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "memory_storage.hpp"
+#include "model.hpp"
+
+namespace net = boost::asio;
+
+static int32_t days_since_epoch(std::chrono::year_month_day date) {
+    return std::chrono::sys_days{date}.time_since_epoch().count();
+}
+
+static OwnerView view_of(const Owner& o) {
+    return OwnerView{.id = o.id, .name = o.name, .address = o.address};
+}
+
+static PetView view_of(const Pet& p) {
+    return PetView{.id = p.id,
+                   .owner_id = p.owner_id,
+                   .chip_id = p.chip_id,
+                   .species = p.species,
+                   .breed = p.breed,
+                   .color = p.color,
+                   .gender = p.gender,
+                   .age = p.age,
+                   .weight = p.weight,
+                   .address = p.address,
+                   .name = p.name};
+}
+
+static SensorView view_of(const Sensor& s) {
+    return SensorView{.id = s.id, .pet_id = s.pet_id, .type = s.type};
+}
+
+// Copies `rows` so that the returned views stay valid after the lock is
+// released and the table is modified.
+template <typename Row, typename View = decltype(view_of(std::declval<Row>()))>
+static RecordSet<View> copy_records(std::vector<Row> rows) {
+    auto backing = std::make_shared<const std::vector<Row>>(std::move(rows));
+    std::vector<View> records;
+    records.reserve(backing->size());
+    for (const Row& row : *backing) {
+        records.push_back(view_of(row));
+    }
+    return make_record_set(std::move(records), std::move(backing));
+}
+
+class MemoryMeasurementStream : public MeasurementStream {
+  public:
+    MemoryMeasurementStream(const MemoryStorage& storage, CassUuid sensor_id,
+                            cass_int64_t from, cass_int64_t to,
+                            StreamDeadline deadline)
+        : storage(storage), sensor_id(sensor_id), next_ts(from), to(to),
+          deadline(deadline) {}
+
+    net::awaitable<bool> next_page() override {
+        this->samples.clear();
+        if (this->exhausted) {
+            co_return false;
+        }
+        co_await this->storage.delay(this->deadline.page(this->first_page));
+        this->first_page = false;
+
+        std::shared_lock lock(this->storage.mutex);
+        auto partition = this->storage.measurements.find(this->sensor_id);
+        if (partition != this->storage.measurements.end()) {
+            auto it = partition->second.lower_bound(this->next_ts);
+            auto end = partition->second.upper_bound(this->to);
+            for (; it != end && this->samples.size() <
+                                    (size_t)this->storage.page_size;
+                 ++it) {
+                this->samples.push_back(
+                    Sample{.ts = it->first, .value = it->second});
+            }
+            this->exhausted = it == end;
+        } else {
+            this->exhausted = true;
+        }
+        if (!this->samples.empty()) {
+            this->next_ts = this->samples.back().ts + 1;
+        }
+        co_return !this->samples.empty();
+    }
+
+    std::span<const Sample> page() const override { return this->samples; }
+
+  private:
+    const MemoryStorage& storage;
+    CassUuid sensor_id;
+    cass_int64_t next_ts;
+    cass_int64_t to;
+    StreamDeadline deadline;
+    bool first_page = true;
+    bool exhausted = false;
+    std::vector<Sample> samples;
+};
+
+MemoryStorage::MemoryStorage(std::chrono::microseconds latency, int page_size)
+    : latency(latency), page_size(std::max(1, page_size)) {}
+
+CassUuid MemoryStorage::seed(size_t owner_count, int hours) {
+    using namespace std::chrono;
+
+    // Version 1 UUIDs whose timestamp encodes the entity kind and index,
+    // so the same ids are generated on every run.
+    auto uuid = [](uint64_t kind, uint64_t i) {
+        return CassUuid{.time_and_version = (1ull << 60) | (kind << 40) | i,
+                        .clock_seq_and_node = 0x8000000000000000ull};
+    };
+
+    constexpr int64_t minute_ms = 60'000;
+    int64_t now_ms =
+        duration_cast<milliseconds>(system_clock::now().time_since_epoch())
+            .count();
+    int64_t first_ms =
+        (now_ms - hours * 60 * minute_ms) / minute_ms * minute_ms;
+
+    std::unique_lock lock(this->mutex);
+    for (uint64_t i = 0; i < owner_count; i++) {
+        Owner owner{.id = uuid(1, i),
+                    .name = std::format("Owner {}", i),
+                    .address = "123 Main St"};
+        this->owners[owner.id] = owner;
+
+        Pet pet{.id = uuid(2, i),
+                .owner_id = owner.id,
+                .chip_id = std::format("chip-{}", i),
+                .species = "Dog",
+                .breed = "Golden Retriever",
+                .color = "Golden",
+                .gender = "Male",
+                .age = 5,
+                .weight = 30,
+                .address = owner.address,
+                .name = std::format("Pet {}", i)};
+        this->pets[pet.owner_id][pet.id] = pet;
+
+        Sensor temperature{
+            .id = uuid(3, 2 * i), .pet_id = pet.id, .type = "Temperature"};
+        Sensor pulse{
+            .id = uuid(3, 2 * i + 1), .pet_id = pet.id, .type = "Pulse"};
+        for (const Sensor& sensor : {temperature, pulse}) {
+            this->sensors[sensor.pet_id][sensor.id] = sensor;
+        }
+
+        auto& temperatures = this->measurements[temperature.id];
+        auto& pulses = this->measurements[pulse.id];
+        for (int64_t ts = first_ms; ts <= now_ms; ts += minute_ms) {
+            int64_t minute = ts / minute_ms;
+            temperatures.emplace_hint(temperatures.end(), ts,
+                                      35.0f + (minute % 50) / 10.0f);
+            pulses.emplace_hint(pulses.end(), ts, 60.0f + (minute % 40));
+        }
+    }
+    return uuid(1, 0);
+}
+
+net::awaitable<void> MemoryStorage::delay(Deadline deadline) const {
+    if (this->latency.count() > 0) {
+        auto until = std::min<Deadline>(
+            std::chrono::steady_clock::now() + this->latency, deadline);
+        net::steady_timer timer(co_await net::this_coro::executor, until);
+        co_await timer.async_wait(net::use_awaitable);
+    }
+    if (std::chrono::steady_clock::now() >= deadline) {
+        throw DeadlineExceeded();
+    }
+}
+
+void MemoryStorage::delay_blocking() const {
+    if (this->latency.count() > 0) {
+        std::this_thread::sleep_for(this->latency);
+    }
+}
+
+net::awaitable<RecordSet<OwnerView>>
+MemoryStorage::get_owner(CassUuid owner_id, Deadline deadline) {
+    co_await this->delay(deadline);
+
+    std::vector<Owner> rows;
+    {
+        std::shared_lock lock(this->mutex);
+        auto it = this->owners.find(owner_id);
+        if (it != this->owners.end()) {
+            rows.push_back(it->second);
+        }
+    }
+    co_return copy_records(std::move(rows));
+}
+
+net::awaitable<RecordSet<PetView>>
+MemoryStorage::get_pets(CassUuid owner_id, Deadline deadline) {
+    co_await this->delay(deadline);
+
+    std::vector<Pet> rows;
+    {
+        std::shared_lock lock(this->mutex);
+        auto partition = this->pets.find(owner_id);
+        if (partition != this->pets.end()) {
+            for (const auto& [pet_id, pet] : partition->second) {
+                rows.push_back(pet);
+            }
+        }
+    }
+    co_return copy_records(std::move(rows));
+}
+
+net::awaitable<RecordSet<SensorView>>
+MemoryStorage::get_sensors(CassUuid pet_id, Deadline deadline) {
+    co_await this->delay(deadline);
+
+    std::vector<Sensor> rows;
+    {
+        std::shared_lock lock(this->mutex);
+        auto partition = this->sensors.find(pet_id);
+        if (partition != this->sensors.end()) {
+            for (const auto& [sensor_id, sensor] : partition->second) {
+                rows.push_back(sensor);
+            }
+        }
+    }
+    co_return copy_records(std::move(rows));
+}
+
+std::unique_ptr<MeasurementStream>
+MemoryStorage::get_measurements(CassUuid sensor_id, cass_int64_t from,
+                                cass_int64_t to, StreamDeadline deadline) {
+    return std::make_unique<MemoryMeasurementStream>(*this, sensor_id, from,
+                                                     to, deadline);
+}
+
+net::awaitable<std::vector<std::pair<int32_t, float>>>
+MemoryStorage::get_sensor_avg(CassUuid sensor_id,
+                              std::chrono::year_month_day date,
+                              Deadline deadline) {
+    co_await this->delay(deadline);
+
+    int32_t day = days_since_epoch(date);
+    std::vector<std::pair<int32_t, float>> averages;
+    std::shared_lock lock(this->mutex);
+    auto partition = this->sensor_avgs.find(sensor_id);
+    if (partition != this->sensor_avgs.end()) {
+        auto it = partition->second.lower_bound({day, INT32_MIN});
+        for (; it != partition->second.end() && it->first.first == day;
+             ++it) {
+            averages.emplace_back(it->first.second, it->second);
+        }
+    }
+    co_return averages;
+}
+
+net::awaitable<void>
+MemoryStorage::insert_sensor_avg(CassUuid sensor_id,
+                                 std::chrono::year_month_day date,
+                                 int32_t hour, float value,
+                                 Deadline deadline) {
+    co_await this->delay(deadline);
+
+    std::unique_lock lock(this->mutex);
+    this->sensor_avgs[sensor_id][{days_since_epoch(date), hour}] = value;
+}
+
+void MemoryStorage::insert_owner(const Owner& owner) {
+    this->delay_blocking();
+    std::unique_lock lock(this->mutex);
+    this->owners[owner.id] = owner;
+}
+
+void MemoryStorage::insert_pet(const Pet& pet) {
+    this->delay_blocking();
+    std::unique_lock lock(this->mutex);
+    this->pets[pet.owner_id][pet.id] = pet;
+}
+
+void MemoryStorage::insert_sensor(const Sensor& sensor) {
+    this->delay_blocking();
+    std::unique_lock lock(this->mutex);
+    this->sensors[sensor.pet_id][sensor.id] = sensor;
+}
+
+void MemoryStorage::write_measurements(std::vector<Measure> measures,
+                                       WriteCallback done) {
+    this->delay_blocking();
+    {
+        std::unique_lock lock(this->mutex);
+        for (const Measure& m : measures) {
+            this->measurements[m.sensor_id][m.ts] = m.value;
+        }
+    }
+    done(nullptr);
+}
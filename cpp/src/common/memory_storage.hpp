@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <shared_mutex>
+#include <utility>
+
+#include "model.hpp"
+#include "storage.hpp"
+
+// In-process `Storage` for benchmarks and tests.
+//
+// Each of the five `carepet` tables is a map from partition key to a
+// sorted map of its rows, so reads come back in clustering order like
+// they do from ScyllaDB. Every operation can be delayed by a fixed
+// `latency` to model the network round trip; reads and writes made for a
+// request still honor its deadline.
+class MemoryStorage : public Storage {
+  public:
+    MemoryStorage(std::chrono::microseconds latency, int page_size);
+
+    // Fills the tables with `owners` owners, each with one pet that has a
+    // temperature and a pulse sensor reporting once a minute over the last
+    // `hours` hours. The generated ids are the same on every run; the id
+    // of the first owner is returned.
+    CassUuid seed(size_t owners, int hours);
+
+    boost::asio::awaitable<RecordSet<OwnerView>>
+    get_owner(CassUuid owner_id, Deadline deadline) override;
+
+    boost::asio::awaitable<RecordSet<PetView>>
+    get_pets(CassUuid owner_id, Deadline deadline) override;
+
+    boost::asio::awaitable<RecordSet<SensorView>>
+    get_sensors(CassUuid pet_id, Deadline deadline) override;
+
+    std::unique_ptr<MeasurementStream>
+    get_measurements(CassUuid sensor_id, cass_int64_t from, cass_int64_t to,
+                     StreamDeadline deadline) override;
+
+    boost::asio::awaitable<std::vector<std::pair<int32_t, float>>>
+    get_sensor_avg(CassUuid sensor_id, std::chrono::year_month_day date,
+                   Deadline deadline) override;
+
+    boost::asio::awaitable<void>
+    insert_sensor_avg(CassUuid sensor_id, std::chrono::year_month_day date,
+                      int32_t hour, float value,
+                      Deadline deadline) override;
+
+    void insert_owner(const Owner& owner) override;
+
+    void insert_pet(const Pet& pet) override;
+
+    void insert_sensor(const Sensor& sensor) override;
+
+    void write_measurements(std::vector<Measure> measures,
+                            WriteCallback done) override;
+
+  private:
+    friend class MemoryMeasurementStream;
+
+    template <typename Row>
+    using Partitions = std::map<CassUuid, Row, UuidLess>;
+    template <typename Row>
+    using ClusteredPartitions =
+        std::map<CassUuid, std::map<CassUuid, Row, UuidLess>, UuidLess>;
+
+    // Waits for the configured latency, or until `deadline` and then
+    // throws `DeadlineExceeded`.
+    boost::asio::awaitable<void> delay(Deadline deadline) const;
+    void delay_blocking() const;
+
+    const std::chrono::microseconds latency;
+    const int page_size;
+
+    mutable std::shared_mutex mutex;
+    Partitions<Owner> owners;
+    ClusteredPartitions<Pet> pets;
+    ClusteredPartitions<Sensor> sensors;
+    // sensor_id -> ts -> value
+    Partitions<std::map<cass_int64_t, float>> measurements;
+    // sensor_id -> (days since epoch, hour) -> value
+    Partitions<std::map<std::pair<int32_t, int32_t>, float>> sensor_avgs;
+};
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassandra.h>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "metrics.hpp"
+
+uint64_t ShardedCounter::load() const {
+    uint64_t total = 0;
+    for (const Shard& shard : this->shards) {
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    std::array<uint64_t, bucket_count> counts{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    for (const Shard& shard : this->shards) {
+        for (size_t i = 0; i < bucket_count; i++) {
+            uint64_t n = shard.buckets[i].load(std::memory_order_relaxed);
+            counts[i] += n;
+            count += n;
+        }
+        sum += shard.sum.load(std::memory_order_relaxed);
+        max = std::max(max, shard.max.load(std::memory_order_relaxed));
+    }
+
+    // Smallest recorded value with at least `quantile` of all values at
+    // or below it, reported as the upper bound of its bucket.
+    auto percentile = [&](double quantile) {
+        uint64_t rank = std::max<uint64_t>(1, quantile * count + 0.5);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return std::chrono::microseconds(
+                    std::min(bucket_upper_bound(i), max));
+            }
+        }
+        return std::chrono::microseconds(max);
+    };
+
+    if (count == 0) {
+        return Snapshot{};
+    }
+    return Snapshot{
+        .count = count,
+        .p50 = percentile(0.5),
+        .p99 = percentile(0.99),
+        .p999 = percentile(0.999),
+        .max = std::chrono::microseconds(max),
+        .sum = std::chrono::microseconds(sum),
+    };
+}
+
+std::vector<uint64_t> LatencyHistogram::cumulative_counts(
+    std::span<const std::chrono::microseconds> bounds) const {
+    std::vector<uint64_t> result(bounds.size());
+    size_t bound = 0;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; i++) {
+        // Close the bounds that bucket `i` reaches beyond.
+        while (bound < bounds.size() &&
+               bucket_upper_bound(i) > uint64_t(bounds[bound].count())) {
+            result[bound++] = seen;
+        }
+        for (const Shard& shard : this->shards) {
+            seen += shard.buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+    while (bound < bounds.size()) {
+        result[bound++] = seen;
+    }
+    return result;
+}
+
+void StatementMetrics::record(std::chrono::steady_clock::time_point started,
+                              const CassResult* result, size_t bytes) {
+    this->latency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started));
+    this->bytes.add(bytes);
+    if (result) {
+        this->rows.add(cass_result_row_count(result));
+    } else {
+        this->errors.add(1);
+    }
+}
+
+StatementStats StatementMetrics::stats() const {
+    LatencyHistogram::Snapshot latency = this->latency.snapshot();
+    return StatementStats{
+        .query = this->query,
+        .executions = latency.count,
+        .errors = this->errors.load(),
+        .rows = this->rows.load(),
+        .bytes = this->bytes.load(),
+        .retries = this->retries.load(),
+        .hedges = this->hedges.load(),
+        .hedge_wins = this->hedge_wins.load(),
+        .deadlines_exceeded = this->deadlines_exceeded.load(),
+        .latency = latency,
+    };
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassandra.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Number of copies kept by sharded metrics. Each thread records into one
+// of them, so concurrent recorders rarely touch the same cache line.
+inline constexpr size_t metric_shards = 8;
+
+inline size_t this_thread_shard() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t shard =
+        next.fetch_add(1, std::memory_order_relaxed) % metric_shards;
+    return shard;
+}
+
+// Monotonic counter sharded per thread.
+class ShardedCounter {
+  public:
+    void add(uint64_t n) {
+        this->shards[this_thread_shard()].value.fetch_add(
+            n, std::memory_order_relaxed);
+    }
+
+    uint64_t load() const;
+
+  private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+
+    std::array<Shard, metric_shards> shards;
+};
+
+// Lock-free latency histogram with HdrHistogram-style log-linear buckets:
+// latencies below 32us are exact, larger ones are kept within ~3% up to
+// about 70 minutes. Recording is a relaxed increment on the shard of the
+// calling thread; snapshots merge all shards.
+class LatencyHistogram {
+  public:
+    struct Snapshot {
+        uint64_t count;
+        std::chrono::microseconds p50;
+        std::chrono::microseconds p99;
+        std::chrono::microseconds p999;
+        std::chrono::microseconds max;
+        std::chrono::microseconds sum;
+    };
+
+    void record(std::chrono::microseconds latency) {
+        uint64_t value = latency.count() < 0 ? 0 : latency.count();
+        Shard& shard = this->shards[this_thread_shard()];
+        shard.buckets[bucket_index(value)].fetch_add(
+            1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t max = shard.max.load(std::memory_order_relaxed);
+        while (value > max && !shard.max.compare_exchange_weak(
+                                  max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    Snapshot snapshot() const;
+
+    // Number of recorded values at or below each of the ascending
+    // `bounds`, the cumulative buckets of a Prometheus histogram. Values
+    // are attributed by bucket, so a bound inside a bucket counts that
+    // bucket as above it.
+    std::vector<uint64_t>
+    cumulative_counts(std::span<const std::chrono::microseconds> bounds) const;
+
+  private:
+    static constexpr int sub_bucket_bits = 5;
+    static constexpr uint64_t sub_buckets = 1 << sub_bucket_bits;
+    static constexpr int max_bits = 32;
+    static constexpr size_t bucket_count =
+        sub_buckets + (max_bits - sub_bucket_bits) * sub_buckets;
+
+    static constexpr size_t bucket_index(uint64_t value) {
+        if (value < sub_buckets) {
+            return value;
+        }
+        int msb = std::bit_width(value) - 1;
+        if (msb >= max_bits) {
+            return bucket_count - 1;
+        }
+        int shift = msb - sub_bucket_bits;
+        return sub_buckets + shift * sub_buckets +
+               ((value >> shift) & (sub_buckets - 1));
+    }
+
+    // Largest value that falls into bucket `index`.
+    static constexpr uint64_t bucket_upper_bound(size_t index) {
+        if (index < sub_buckets) {
+            return index;
+        }
+        int shift = (index - sub_buckets) / sub_buckets;
+        uint64_t sub = (index - sub_buckets) % sub_buckets;
+        uint64_t low = (sub_buckets | sub) << shift;
+        return low + (uint64_t(1) << shift) - 1;
+    }
+
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, bucket_count> buckets{};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+    };
+
+    std::array<Shard, metric_shards> shards;
+};
+
+// Client-side statistics of one prepared statement, as seen by
+// `Database`. `bytes` counts the bound parameter payload sent. Every
+// retry and hedge is an execution of its own.
+struct StatementStats {
+    std::string query;
+    uint64_t executions;
+    uint64_t errors;
+    uint64_t rows;
+    uint64_t bytes;
+    uint64_t retries;
+    uint64_t hedges;
+    // Hedges that answered before the execution they duplicated.
+    uint64_t hedge_wins;
+    uint64_t deadlines_exceeded;
+    LatencyHistogram::Snapshot latency;
+};
+
+// Statistics of one in-process cache. `negative_hits` found a
+// remembered absence.
+struct CacheStats {
+    std::string name;
+    uint64_t hits;
+    uint64_t negative_hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t invalidations;
+    uint64_t entries;
+    // Memory held by the entries, as estimated by the cache's user.
+    uint64_t bytes;
+};
+
+// Live metrics of one prepared statement. Recorded from driver callback
+// threads without locking.
+class StatementMetrics {
+  public:
+    explicit StatementMetrics(std::string query) : query(std::move(query)) {}
+
+    // Records one execution that started at `started`. A null `result`
+    // counts as an error.
+    void record(std::chrono::steady_clock::time_point started,
+                const CassResult* result, size_t bytes);
+
+    void record_retry() { this->retries.add(1); }
+
+    void record_hedge() { this->hedges.add(1); }
+
+    void record_hedge_win() { this->hedge_wins.add(1); }
+
+    void record_deadline_exceeded() { this->deadlines_exceeded.add(1); }
+
+    StatementStats stats() const;
+
+  private:
+    std::string query;
+    LatencyHistogram latency;
+    ShardedCounter errors;
+    ShardedCounter rows;
+    ShardedCounter bytes;
+    ShardedCounter retries;
+    ShardedCounter hedges;
+    ShardedCounter hedge_wins;
+    ShardedCounter deadlines_exceeded;
+};
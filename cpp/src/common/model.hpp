@@ -1,7 +1,38 @@
 #pragma once
 
 #include <cassandra.h>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+#include "schema.hpp"
+
+// Orders UUIDs like the `uuid` clustering columns do for time-based
+// UUIDs: by version first, then by timestamp.
+struct UuidLess {
+    bool operator()(const CassUuid& a, const CassUuid& b) const {
+        return std::pair(a.time_and_version, a.clock_seq_and_node) <
+               std::pair(b.time_and_version, b.clock_seq_and_node);
+    }
+};
+
+struct UuidHash {
+    size_t operator()(const CassUuid& uuid) const {
+        // Time-based UUIDs differ mostly in the low bits of the time.
+        uint64_t h = uuid.time_and_version * 0x9e3779b97f4a7c15ULL;
+        return size_t(h ^ (h >> 29) ^ uuid.clock_seq_and_node);
+    }
+};
+
+struct UuidEqual {
+    bool operator()(const CassUuid& a, const CassUuid& b) const {
+        return a.time_and_version == b.time_and_version &&
+               a.clock_seq_and_node == b.clock_seq_and_node;
+    }
+};
 
 struct Owner {
     CassUuid id;
@@ -40,3 +71,114 @@ struct SensorAvg {
     std::string date;
     float value;
 };
+
+// Non-owning counterparts of the records above, filled straight from
+// `Rows` with `std::string_view` columns. They must not outlive the
+// `QueryResult` they were read from.
+
+struct OwnerView {
+    CassUuid id;
+    std::string_view name;
+    std::string_view address;
+};
+
+struct PetView {
+    CassUuid id;
+    CassUuid owner_id;
+    std::string_view chip_id;
+    std::string_view species;
+    std::string_view breed;
+    std::string_view color;
+    std::string_view gender;
+    int32_t age;
+    float weight;
+    std::string_view address;
+    std::string_view name;
+};
+
+struct SensorView {
+    CassUuid id;
+    CassUuid pet_id;
+    std::string_view type;
+};
+
+// Column mappings. Owning records and their views read the same columns.
+
+template <> struct Schema<Owner> {
+    static constexpr std::string_view table = "carepet.owner";
+    static constexpr std::tuple columns{
+        Column{"owner_id", &Owner::id},
+        Column{"name", &Owner::name},
+        Column{"address", &Owner::address},
+    };
+};
+
+template <> struct Schema<OwnerView> {
+    static constexpr std::string_view table = Schema<Owner>::table;
+    static constexpr std::tuple columns{
+        Column{"owner_id", &OwnerView::id},
+        Column{"name", &OwnerView::name},
+        Column{"address", &OwnerView::address},
+    };
+};
+
+template <> struct Schema<Pet> {
+    static constexpr std::string_view table = "carepet.pet";
+    static constexpr std::tuple columns{
+        Column{"pet_id", &Pet::id},
+        Column{"owner_id", &Pet::owner_id},
+        Column{"chip_id", &Pet::chip_id},
+        Column{"species", &Pet::species},
+        Column{"breed", &Pet::breed},
+        Column{"color", &Pet::color},
+        Column{"gender", &Pet::gender},
+        Column{"age", &Pet::age},
+        Column{"weight", &Pet::weight},
+        Column{"address", &Pet::address},
+        Column{"name", &Pet::name},
+    };
+};
+
+template <> struct Schema<PetView> {
+    static constexpr std::string_view table = Schema<Pet>::table;
+    static constexpr std::tuple columns{
+        Column{"pet_id", &PetView::id},
+        Column{"owner_id", &PetView::owner_id},
+        Column{"chip_id", &PetView::chip_id},
+        Column{"species", &PetView::species},
+        Column{"breed", &PetView::breed},
+        Column{"color", &PetView::color},
+        Column{"gender", &PetView::gender},
+        Column{"age", &PetView::age},
+        Column{"weight", &PetView::weight},
+        Column{"address", &PetView::address},
+        Column{"name", &PetView::name},
+    };
+};
+
+template <> struct Schema<Sensor> {
+    static constexpr std::string_view table = "carepet.sensor";
+    static constexpr std::tuple columns{
+        Column{"sensor_id", &Sensor::id},
+        Column{"pet_id", &Sensor::pet_id},
+        Column{"type", &Sensor::type},
+    };
+};
+
+template <> struct Schema<SensorView> {
+    static constexpr std::string_view table = Schema<Sensor>::table;
+    static constexpr std::tuple columns{
+        Column{"sensor_id", &SensorView::id},
+        Column{"pet_id", &SensorView::pet_id},
+        Column{"type", &SensorView::type},
+    };
+};
+
+template <> struct Schema<Measure> {
+    static constexpr std::string_view table = "carepet.measurement";
+    static constexpr std::tuple columns{
+        Column{"sensor_id", &Measure::sensor_id},
+        Column{"ts", &Measure::ts},
+        Column{"value", &Measure::value},
+    };
+};
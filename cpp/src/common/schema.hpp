@@ -0,0 +1,84 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+// Compile-time mapping between a record struct and a table.
+//
+// A record is mapped by specializing `Schema` with the table name and one
+// `Column` per selected column, in the order they are read and bound:
+//
+//     template <> struct Schema<Owner> {
+//         static constexpr std::string_view table = "carepet.owner";
+//         static constexpr std::tuple columns{
+//             Column{"owner_id", &Owner::id},
+//             Column{"name", &Owner::name},
+//         };
+//     };
+//
+// `Rows<Owner>` then decodes each row straight into an `Owner`, and the
+// queries below are generated from the same column list.
+template <typename Record> struct Schema;
+
+template <typename Record, typename T> struct Column {
+    using type = T;
+
+    std::string_view name;
+    T Record::*member;
+};
+
+template <typename Record, typename T>
+Column(std::string_view, T Record::*) -> Column<Record, T>;
+
+template <typename Record>
+concept Mapped = requires {
+    { Schema<Record>::table } -> std::convertible_to<std::string_view>;
+    Schema<Record>::columns;
+};
+
+template <Mapped Record>
+inline constexpr std::size_t column_count_v =
+    std::tuple_size_v<std::remove_cv_t<decltype(Schema<Record>::columns)>>;
+
+// Calls `f(column)` for every column of `Record`, in order.
+template <Mapped Record, typename F> constexpr void for_each_column(F&& f) {
+    std::apply([&](const auto&... column) { (f(column), ...); },
+               Schema<Record>::columns);
+}
+
+// "a, b, c" for the columns of `Record`.
+template <Mapped Record> std::string column_list() {
+    std::string list;
+    for_each_column<Record>([&](const auto& column) {
+        if (!list.empty()) {
+            list += ", ";
+        }
+        list += column.name;
+    });
+    return list;
+}
+
+// SELECT of every column of `Record` restricted by the CQL `where` clause.
+template <Mapped Record> std::string select_query(std::string_view where) {
+    std::string query = "SELECT " + column_list<Record>() + " FROM ";
+    query += Schema<Record>::table;
+    query += " WHERE ";
+    query += where;
+    return query;
+}
+
+// INSERT of every column of `Record`, bound in column order.
+template <Mapped Record> std::string insert_query() {
+    std::string markers;
+    for (std::size_t i = 0; i < column_count_v<Record>; i++) {
+        markers += i == 0 ? "?" : ", ?";
+    }
+    std::string query = "INSERT INTO ";
+    query += Schema<Record>::table;
+    query += " (" + column_list<Record>() + ") VALUES (" + markers + ")";
+    return query;
+}
@@ -0,0 +1,158 @@
+#include <boost/asio/awaitable.hpp>
+#include <cassandra.h>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "config.hpp"
+#include "database.hpp"
+#include "model.hpp"
+#include "scylla_storage.hpp"
+
+namespace net = boost::asio;
+
+class ScyllaMeasurementStream : public MeasurementStream {
+  public:
+    ScyllaMeasurementStream(RowStream<Sample> rows) : rows(std::move(rows)) {}
+
+    net::awaitable<bool> next_page() override {
+        this->samples.clear();
+        if (!co_await this->rows.co_next_page()) {
+            co_return false;
+        }
+        for (const Sample& sample : this->rows.page()) {
+            this->samples.push_back(sample);
+        }
+        co_return true;
+    }
+
+    std::span<const Sample> page() const override { return this->samples; }
+
+  private:
+    RowStream<Sample> rows;
+    std::vector<Sample> samples;
+};
+
+// Column lists and bind order come from the `Schema` mappings in
+// model.hpp, so queries and records cannot drift apart.
+ScyllaStorage::ScyllaStorage(Database db)
+    : db(std::move(db)),
+      fetch_owner(this->db.prepared(select_query<OwnerView>("owner_id = ?"),
+                                    profiles::read, true)),
+      fetch_pets(this->db.prepared(select_query<PetView>("owner_id = ?"),
+                                   profiles::read, true)),
+      fetch_sensors(this->db.prepared(select_query<SensorView>("pet_id = ?"),
+                                      profiles::read, true)),
+      fetch_measurements(this->db.prepared(
+          select_query<Sample>("sensor_id = ? AND ts >= ? AND ts <= ?"),
+          profiles::read, true)),
+      fetch_avg(this->db.prepared("SELECT hour, value FROM carepet.sensor_avg "
+                                  "WHERE sensor_id = ? AND date = ?",
+                                  profiles::read, true)),
+      insert_sensor_avg_stmt(this->db.prepared(
+          "INSERT INTO carepet.sensor_avg "
+          "(sensor_id, date, hour, value) VALUES (?, ?, ?, ?)",
+          profiles::write, true)),
+      insert_owner_stmt(this->db.prepared(insert_query<Owner>(),
+                                          profiles::write, true)),
+      insert_pet_stmt(this->db.prepared(insert_query<Pet>(), profiles::write,
+                                        true)),
+      insert_sensor_stmt(this->db.prepared(insert_query<Sensor>(),
+                                           profiles::write, true)),
+      insert_measure_stmt(this->db.prepared(insert_query<Measure>(),
+                                            profiles::write, true)) {}
+
+// Reads every row of `result` as a `View` record backed by the result.
+template <Mapped View> static RecordSet<View> read_records(QueryResult result) {
+    std::vector<View> records;
+    for (const View& record : result.rows<View>()) {
+        records.push_back(record);
+    }
+    return make_record_set(std::move(records), result.shared());
+}
+
+net::awaitable<RecordSet<OwnerView>>
+ScyllaStorage::get_owner(CassUuid owner_id, Deadline deadline) {
+    co_return read_records<OwnerView>(
+        co_await db.co_execute(deadline, *fetch_owner, owner_id));
+}
+
+net::awaitable<RecordSet<PetView>>
+ScyllaStorage::get_pets(CassUuid owner_id, Deadline deadline) {
+    co_return read_records<PetView>(
+        co_await db.co_execute(deadline, *fetch_pets, owner_id));
+}
+
+net::awaitable<RecordSet<SensorView>>
+ScyllaStorage::get_sensors(CassUuid pet_id, Deadline deadline) {
+    co_return read_records<SensorView>(
+        co_await db.co_execute(deadline, *fetch_sensors, pet_id));
+}
+
+std::unique_ptr<MeasurementStream>
+ScyllaStorage::get_measurements(CassUuid sensor_id, cass_int64_t from,
+                                cass_int64_t to, StreamDeadline deadline) {
+    return std::make_unique<ScyllaMeasurementStream>(db.stream<Sample>(
+        deadline, *fetch_measurements, sensor_id, from, to));
+}
+
+net::awaitable<std::vector<std::pair<int32_t, float>>>
+ScyllaStorage::get_sensor_avg(CassUuid sensor_id,
+                              std::chrono::year_month_day date,
+                              Deadline deadline) {
+    QueryResult result =
+        co_await db.co_execute(deadline, *fetch_avg, sensor_id, date);
+    Rows rows = result.rows<int32_t, float>();
+
+    std::vector<std::pair<int32_t, float>> averages;
+    for (auto [hour, value] : rows) {
+        averages.emplace_back(hour, value);
+    }
+    co_return averages;
+}
+
+net::awaitable<void>
+ScyllaStorage::insert_sensor_avg(CassUuid sensor_id,
+                                 std::chrono::year_month_day date,
+                                 int32_t hour, float value,
+                                 Deadline deadline) {
+    co_await db.co_execute(deadline, *insert_sensor_avg_stmt, sensor_id, date,
+                           hour, value);
+}
+
+void ScyllaStorage::insert_owner(const Owner& owner) {
+    db.execute_record(*insert_owner_stmt, owner);
+}
+
+void ScyllaStorage::insert_pet(const Pet& pet) {
+    db.execute_record(*insert_pet_stmt, pet);
+}
+
+void ScyllaStorage::insert_sensor(const Sensor& sensor) {
+    db.execute_record(*insert_sensor_stmt, sensor);
+}
+
+void ScyllaStorage::write_measurements(std::vector<Measure> measures,
+                                       WriteCallback done) {
+    // All rows share a partition, so an unlogged batch is applied as a
+    // single mutation on its replicas.
+    Batch batch(CASS_BATCH_TYPE_UNLOGGED, profiles::write);
+    for (const Measure& m : measures) {
+        batch.add_record(*insert_measure_stmt, m);
+    }
+    db.execute_async(batch,
+                     [done = std::move(done)](std::exception_ptr error,
+                                              QueryResult) { done(error); });
+}
+
+std::vector<StatementStats> ScyllaStorage::statement_stats() const {
+    return db.statement_stats();
+}
+
+std::vector<CacheStats> ScyllaStorage::cache_stats() const {
+    return {db.prepared_cache_stats()};
+}
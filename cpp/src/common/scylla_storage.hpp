@@ -0,0 +1,61 @@
+#pragma once
+
+#include "database.hpp"
+#include "storage.hpp"
+
+// `Storage` backed by a ScyllaDB cluster.
+class ScyllaStorage : public Storage {
+  public:
+    explicit ScyllaStorage(Database db);
+
+    boost::asio::awaitable<RecordSet<OwnerView>>
+    get_owner(CassUuid owner_id, Deadline deadline) override;
+
+    boost::asio::awaitable<RecordSet<PetView>>
+    get_pets(CassUuid owner_id, Deadline deadline) override;
+
+    boost::asio::awaitable<RecordSet<SensorView>>
+    get_sensors(CassUuid pet_id, Deadline deadline) override;
+
+    std::unique_ptr<MeasurementStream>
+    get_measurements(CassUuid sensor_id, cass_int64_t from, cass_int64_t to,
+                     StreamDeadline deadline) override;
+
+    boost::asio::awaitable<std::vector<std::pair<int32_t, float>>>
+    get_sensor_avg(CassUuid sensor_id, std::chrono::year_month_day date,
+                   Deadline deadline) override;
+
+    boost::asio::awaitable<void>
+    insert_sensor_avg(CassUuid sensor_id, std::chrono::year_month_day date,
+                      int32_t hour, float value,
+                      Deadline deadline) override;
+
+    void insert_owner(const Owner& owner) override;
+
+    void insert_pet(const Pet& pet) override;
+
+    void insert_sensor(const Sensor& sensor) override;
+
+    void write_measurements(std::vector<Measure> measures,
+                            WriteCallback done) override;
+
+    std::vector<StatementStats> statement_stats() const override;
+
+    std::vector<CacheStats> cache_stats() const override;
+
+  private:
+    // Statements come from the prepared statement cache of `db`.
+    using Prepared = std::shared_ptr<const PreparedStatement>;
+
+    Database db;
+    Prepared fetch_owner;
+    Prepared fetch_pets;
+    Prepared fetch_sensors;
+    Prepared fetch_measurements;
+    Prepared fetch_avg;
+    Prepared insert_sensor_avg_stmt;
+    Prepared insert_owner_stmt;
+    Prepared insert_pet_stmt;
+    Prepared insert_sensor_stmt;
+    Prepared insert_measure_stmt;
+};
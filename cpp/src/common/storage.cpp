@@ -0,0 +1,53 @@
+#include <boost/program_options.hpp>
+#include <cassandra.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "database.hpp"
+#include "memory_storage.hpp"
+#include "scylla_storage.hpp"
+#include "storage.hpp"
+
+namespace po = boost::program_options;
+
+po::options_description storage_options() {
+    po::options_description desc("Storage options");
+    // clang-format off
+    desc.add_options()
+        ("storage", po::value<std::string>()->default_value("scylla"), "Storage backend: scylla, or memory (in-process, for benchmarks and tests)")
+        ("memory-latency-us", po::value<int>()->default_value(0), "[Storage: memory] Latency added to every operation")
+        ("memory-seed-owners", po::value<size_t>()->default_value(0), "[Storage: memory] Number of generated owners, each with a pet and two sensors")
+        ("memory-seed-hours", po::value<int>()->default_value(24), "[Storage: memory] Hours of generated per-minute measurements")
+        ("metadata-cache-mb", po::value<size_t>()->default_value(64), "[Mode: server] Memory for cached owners, pets and sensors (0: off)")
+        ("metadata-cache-ttl-s", po::value<int>()->default_value(60), "[Mode: server] Time a cached owner, pet list or sensor list is served")
+        ("metadata-cache-negative-ttl-s", po::value<int>()->default_value(5), "[Mode: server] Time an owner, pet list or sensor list found empty is remembered");
+    // clang-format on
+    return desc;
+}
+
+std::unique_ptr<Storage> make_storage(const po::variables_map& vm) {
+    std::string backend = vm["storage"].as<std::string>();
+    if (backend == "scylla") {
+        return std::make_unique<ScyllaStorage>(Database(vm));
+    }
+    if (backend == "memory") {
+        auto storage = std::make_unique<MemoryStorage>(
+            std::chrono::microseconds(vm["memory-latency-us"].as<int>()),
+            vm["page-size"].as<int>());
+
+        size_t owners = vm["memory-seed-owners"].as<size_t>();
+        if (owners > 0) {
+            CassUuid first_owner_id =
+                storage->seed(owners, vm["memory-seed-hours"].as<int>());
+            char uuid_str[CASS_UUID_STRING_LENGTH];
+            cass_uuid_string(first_owner_id, uuid_str);
+            std::cout << "Seeded in-memory storage with " << owners
+                      << " owners, first owner id: " << uuid_str << "\n";
+        }
+        return storage;
+    }
+    throw std::invalid_argument("Unknown storage backend: " + backend);
+}
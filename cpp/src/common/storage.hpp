@@ -0,0 +1,134 @@
+#pragma once
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/program_options.hpp>
+#include <cassandra.h>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "deadline.hpp"
+#include "metrics.hpp"
+#include "model.hpp"
+
+// Records returned by a `Storage`. `backing` keeps alive both the records
+// and the memory they point into (a driver result, a copy of in-memory
+// rows, ...), so copying a set only bumps a reference count.
+template <typename View> struct RecordSet {
+    std::span<const View> records;
+    std::shared_ptr<const void> backing;
+};
+
+// A set of `records`, which point into `viewed`. Both are moved into the
+// backing of the set.
+template <typename View>
+RecordSet<View> make_record_set(std::vector<View> records,
+                                std::shared_ptr<const void> viewed) {
+    struct Backing {
+        std::vector<View> records;
+        std::shared_ptr<const void> viewed;
+    };
+    auto backing = std::make_shared<const Backing>(
+        Backing{std::move(records), std::move(viewed)});
+    return RecordSet<View>{.records = backing->records,
+                           .backing = std::move(backing)};
+}
+
+// One row of a measurement partition.
+struct Sample {
+    cass_int64_t ts;
+    float value;
+};
+
+template <> struct Schema<Sample> {
+    static constexpr std::string_view table = Schema<Measure>::table;
+    static constexpr std::tuple columns{
+        Column{"ts", &Sample::ts},
+        Column{"value", &Sample::value},
+    };
+};
+
+// Measurements of one sensor in clustering (`ts`) order, read one page
+// at a time so that arbitrarily wide ranges use constant memory.
+class MeasurementStream {
+  public:
+    virtual ~MeasurementStream() = default;
+
+    // Makes the next page current. Returns false once the range is
+    // exhausted.
+    virtual boost::asio::awaitable<bool> next_page() = 0;
+
+    // Rows of the current page, valid until the next call to `next_page`.
+    virtual std::span<const Sample> page() const = 0;
+};
+
+// Access to the `carepet` tables used by the server and the sensor
+// simulation.
+//
+// Read and server-side write operations are coroutines that suspend the
+// caller while the backend works. They throw `DeadlineExceeded` once their
+// `deadline` passes. The sensor simulation's writes are blocking, except
+// for measurements: `write_measurements` reports completion through
+// `done`, which may run on any thread.
+class Storage {
+  public:
+    using WriteCallback = std::function<void(std::exception_ptr)>;
+
+    virtual ~Storage() = default;
+
+    virtual boost::asio::awaitable<RecordSet<OwnerView>>
+    get_owner(CassUuid owner_id, Deadline deadline) = 0;
+
+    virtual boost::asio::awaitable<RecordSet<PetView>>
+    get_pets(CassUuid owner_id, Deadline deadline) = 0;
+
+    virtual boost::asio::awaitable<RecordSet<SensorView>>
+    get_sensors(CassUuid pet_id, Deadline deadline) = 0;
+
+    // Pages are read by the deadlines of `deadline`; a plain `Deadline`
+    // bounds the whole range.
+    virtual std::unique_ptr<MeasurementStream>
+    get_measurements(CassUuid sensor_id, cass_int64_t from, cass_int64_t to,
+                     StreamDeadline deadline) = 0;
+
+    // (hour, value) pairs of one day in hour order.
+    virtual boost::asio::awaitable<std::vector<std::pair<int32_t, float>>>
+    get_sensor_avg(CassUuid sensor_id, std::chrono::year_month_day date,
+                   Deadline deadline) = 0;
+
+    virtual boost::asio::awaitable<void>
+    insert_sensor_avg(CassUuid sensor_id, std::chrono::year_month_day date,
+                      int32_t hour, float value, Deadline deadline) = 0;
+
+    virtual void insert_owner(const Owner& owner) = 0;
+
+    virtual void insert_pet(const Pet& pet) = 0;
+
+    virtual void insert_sensor(const Sensor& sensor) = 0;
+
+    // Writes measurements that all belong to one sensor.
+    virtual void write_measurements(std::vector<Measure> measures,
+                                    WriteCallback done) = 0;
+
+    // Per-statement client-side statistics, if the backend keeps any.
+    virtual std::vector<StatementStats> statement_stats() const {
+        return {};
+    }
+
+    // Statistics of in-process caches, if the backend has any.
+    virtual std::vector<CacheStats> cache_stats() const { return {}; }
+};
+
+// Command line (and config file) options consumed by `make_storage`.
+boost::program_options::options_description storage_options();
+
+// Creates the backend selected by the `--storage` option.
+std::unique_ptr<Storage>
+make_storage(const boost::program_options::variables_map& vm);
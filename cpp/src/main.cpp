@@ -1,9 +1,12 @@
 #include <boost/program_options.hpp>
 #include <iostream>
+#include <thread>
 
+#include "config.hpp"
 #include "migrate/migrate.hpp"
 #include "sensor/sensor.hpp"
 #include "server/server.hpp"
+#include "storage.hpp"
 
 namespace po = boost::program_options;
 
@@ -13,13 +16,33 @@ int main(int argc, char* argv[]) {
     desc.add_options()
         ("help,h", "produce help message")
         ("mode", po::value<std::string>(), "run mode: migrate, sensor, or server")
-        ("scylla-host", po::value<std::string>()->default_value("127.0.0.1"), "Scylla host")
+        ("config", po::value<std::string>(), "Config file with options (key = value lines); command line takes precedence")
         ("host", po::value<std::string>()->default_value("127.0.0.1"), "[Mode: server] Server host")
         ("port", po::value<unsigned short>()->default_value(8080), "[Mode: server] Server port")
+        ("threads", po::value<int>()->default_value(std::max(1u, std::thread::hardware_concurrency())), "[Mode: server] Number of I/O threads")
+        ("shards", po::value<int>()->default_value(0), "[Mode: server] Run N single-threaded shards with SO_REUSEPORT acceptors instead of one thread pool (0: off)")
+        ("pin-cpus", po::value<bool>()->default_value(false), "[Mode: server] Pin each shard's thread to its own CPU")
+        ("request-deadline-ms", po::value<int64_t>()->default_value(2000), "[Mode: server] Time budget of one request, including retries")
+        ("stream-page-timeout-ms", po::value<int64_t>()->default_value(2000), "[Mode: server] Time each page of a streamed response after the first may take (0: the request deadline bounds the whole response)")
+        ("max-connections", po::value<size_t>()->default_value(10000), "[Mode: server] Maximum open connections; further ones get 503 and are closed")
+        ("max-requests", po::value<size_t>()->default_value(512), "[Mode: server] Maximum requests handled concurrently")
+        ("request-queue-size", po::value<size_t>()->default_value(1024), "[Mode: server] Requests allowed to wait for a free request slot before shedding with 503")
+        ("retry-after-s", po::value<int>()->default_value(1), "[Mode: server] Retry-After sent with 503 responses")
+        ("idle-timeout-ms", po::value<int64_t>()->default_value(30000), "[Mode: server] Time a keep-alive connection may stay idle")
+        ("http-read-timeout-ms", po::value<int64_t>()->default_value(10000), "[Mode: server] Time to receive a request once it has started")
+        ("http-write-timeout-ms", po::value<int64_t>()->default_value(10000), "[Mode: server] Time to send a response")
+        ("compress-min-bytes", po::value<size_t>()->default_value(1024), "[Mode: server] Smallest response body compressed with gzip or deflate")
+        ("compress-level", po::value<int>()->default_value(6), "[Mode: server] Response compression level from 1 (fastest) to 9 (smallest), 0: off")
+        ("avg-cache-mb", po::value<size_t>()->default_value(32), "[Mode: server] Memory for the responses of completed days' averages (0: off)")
         ("seconds", po::value<int>()->default_value(60), "[Mode: sensor] Sensor run time in seconds")
+        ("batch-size", po::value<size_t>()->default_value(100), "[Mode: sensor] Maximum measurements per partition batch")
+        ("max-in-flight", po::value<size_t>()->default_value(32), "[Mode: sensor] Maximum batches written concurrently")
+        ("flush-interval-ms", po::value<int>()->default_value(1000), "[Mode: sensor] Interval for flushing buffered measurements")
         ("ddl-file", po::value<std::vector<std::string>>()->multitoken()->default_value({"./data/care-pet-ddl.cql"}, "./data/care-pet-ddl.cql"),
             "[Mode: migrate] Files with CQL commands to run (accepts multiple values)");
     // clang-format on
+    desc.add(driver_options());
+    desc.add(storage_options());
 
     po::positional_options_description p;
     p.add("mode", 1);
@@ -28,6 +51,11 @@ int main(int argc, char* argv[]) {
     po::store(
         po::command_line_parser(argc, argv).options(desc).positional(p).run(),
         vm);
+    if (vm.count("config")) {
+        po::store(po::parse_config_file(vm["config"].as<std::string>().c_str(),
+                                        desc),
+                  vm);
+    }
     po::notify(vm);
 
     if (vm.count("help")) {
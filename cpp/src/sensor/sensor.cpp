@@ -1,46 +1,18 @@
 #include <cassandra.h>
 #include <chrono>
+#include <format>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <thread>
 
-#include "database.hpp"
+#include "measurement_writer.hpp"
 #include "model.hpp"
 #include "sensor.hpp"
-
-static void insert_owner(Database& db, const Owner& owner) {
-    const char* query =
-        "INSERT INTO carepet.owner (owner_id, name, address) VALUES (?, ?, ?)";
-    Statement statement(query);
-    db.execute(statement, owner.id, owner.name, owner.address);
-}
-
-static void insert_pet(Database& db, const Pet& pet) {
-    const char* query =
-        "INSERT INTO carepet.pet (owner_id, pet_id, chip_id, species, breed, "
-        "color, gender, age, weight, address, name) VALUES (?, ?, ?, ?, ?, ?, "
-        "?, "
-        "?, ?, ?, ?)";
-    Statement statement(query);
-    db.execute(statement, pet.owner_id, pet.id, pet.chip_id, pet.species,
-               pet.breed, pet.color, pet.gender, pet.age, pet.weight,
-               pet.address, pet.name);
-}
-
-static void insert_sensor(Database& db, const Sensor& sensor) {
-    const char* query =
-        "INSERT INTO carepet.sensor (pet_id, sensor_id, type) VALUES (?, ?, ?)";
-    Statement statement(query);
-    db.execute(statement, sensor.pet_id, sensor.id, sensor.type);
-}
-
-static void insert_measure(Database& db, const PreparedStatement& statement,
-                           const Measure& measure) {
-    db.execute(statement, measure.sensor_id, measure.ts, measure.value);
-}
+#include "storage.hpp"
 
 void run_sensor(const boost::program_options::variables_map& vm) {
-    Database db(vm);
+    std::unique_ptr<Storage> storage = make_storage(vm);
     char uuid_str[CASS_UUID_STRING_LENGTH];
 
     CassUuidGen* uuid_gen = cass_uuid_gen_new();
@@ -51,7 +23,7 @@ void run_sensor(const boost::program_options::variables_map& vm) {
     cass_uuid_gen_time(uuid_gen, &pulse_sensor_id);
 
     Owner owner{.id = owner_id, .name = "John Doe", .address = "123 Main St"};
-    insert_owner(db, owner);
+    storage->insert_owner(owner);
 
     cass_uuid_string(owner_id, uuid_str);
     std::cout << "Owner id: " << uuid_str << "\n";
@@ -69,25 +41,26 @@ void run_sensor(const boost::program_options::variables_map& vm) {
         .address = "123 Main St",
         .name = "Fido",
     };
-    insert_pet(db, pet);
+    storage->insert_pet(pet);
     cass_uuid_string(pet_id, uuid_str);
     std::cout << "Pet id: " << uuid_str << "\n";
 
     Sensor temp_sensor{
         .id = temp_sensor_id, .pet_id = pet.id, .type = "Temperature"};
-    insert_sensor(db, temp_sensor);
+    storage->insert_sensor(temp_sensor);
     cass_uuid_string(temp_sensor_id, uuid_str);
     std::cout << "Temperature sensor id: " << uuid_str << "\n";
 
     Sensor pulse_sensor{
         .id = pulse_sensor_id, .pet_id = pet.id, .type = "Pulse"};
-    insert_sensor(db, pulse_sensor);
+    storage->insert_sensor(pulse_sensor);
     cass_uuid_string(pulse_sensor_id, uuid_str);
     std::cout << "Pulse sensor id: " << uuid_str << "\n";
 
-    PreparedStatement insert_measure_stmt =
-        db.prepare("INSERT INTO carepet.measurement (sensor_id, ts, "
-                   "value) VALUES (?, ?, ?)");
+    MeasurementWriter writer(
+        *storage, vm["batch-size"].as<size_t>(),
+        vm["max-in-flight"].as<size_t>(),
+        std::chrono::milliseconds(vm["flush-interval-ms"].as<int>()));
 
     auto start_time = std::chrono::high_resolution_clock::now();
 
@@ -100,7 +73,7 @@ void run_sensor(const boost::program_options::variables_map& vm) {
                       std::chrono::system_clock::now().time_since_epoch())
                       .count(),
             .value = static_cast<float>(35.0 + (rand() / (RAND_MAX / 5.0)))};
-        insert_measure(db, insert_measure_stmt, temp_measure);
+        writer.add(temp_measure);
 
         Measure pulse_measure{
             .sensor_id = pulse_sensor.id,
@@ -108,8 +81,29 @@ void run_sensor(const boost::program_options::variables_map& vm) {
                       std::chrono::system_clock::now().time_since_epoch())
                       .count(),
             .value = static_cast<float>(60.0 + (rand() / (RAND_MAX / 40.0)))};
-        insert_measure(db, insert_measure_stmt, pulse_measure);
+        writer.add(pulse_measure);
 
         std::this_thread::sleep_for(std::chrono::seconds(1));
     }
+
+    writer.close();
+
+    MeasurementWriter::Stats stats = writer.stats();
+    std::cout << std::format("Wrote {} measurements in {} batches ({:.1f} "
+                             "rows/s). Flush latency avg: {}, max: {}\n",
+                             stats.rows, stats.batches, stats.rows_per_second,
+                             stats.avg_flush_latency, stats.max_flush_latency);
+
+    for (const StatementStats& statement : storage->statement_stats()) {
+        if (statement.executions == 0) {
+            continue;
+        }
+        std::cout << std::format(
+            "{}\n  executions: {}, errors: {}, retries: {}, rows: {}, "
+            "bytes: {}, p50: {}, p99: {}, p999: {}, max: {}\n",
+            statement.query, statement.executions, statement.errors,
+            statement.retries, statement.rows, statement.bytes,
+            statement.latency.p50, statement.latency.p99,
+            statement.latency.p999, statement.latency.max);
+    }
 }
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+#include "admission.hpp"
+
+namespace net = boost::asio;
+
+ServerLimits server_limits(const boost::program_options::variables_map& vm) {
+    return ServerLimits{
+        .max_connections = vm["max-connections"].as<size_t>(),
+        .max_requests = std::max<size_t>(1, vm["max-requests"].as<size_t>()),
+        .queue_size = vm["request-queue-size"].as<size_t>(),
+        .idle_timeout =
+            std::chrono::milliseconds(vm["idle-timeout-ms"].as<int64_t>()),
+        .read_timeout = std::chrono::milliseconds(
+            vm["http-read-timeout-ms"].as<int64_t>()),
+        .write_timeout = std::chrono::milliseconds(
+            vm["http-write-timeout-ms"].as<int64_t>()),
+        .request_deadline = std::chrono::milliseconds(
+            vm["request-deadline-ms"].as<int64_t>()),
+        .retry_after = std::chrono::seconds(vm["retry-after-s"].as<int>()),
+    };
+}
+
+AdmissionControl::AdmissionControl(size_t max_connections,
+                                   size_t max_requests, size_t queue_size)
+    : max_connections(max_connections), max_requests(max_requests),
+      queue_size(queue_size) {}
+
+bool AdmissionControl::open_connection() {
+    std::lock_guard lock(this->mutex);
+    if (this->connections >= this->max_connections) {
+        return false;
+    }
+    this->connections++;
+    return true;
+}
+
+void AdmissionControl::close_connection() {
+    std::lock_guard lock(this->mutex);
+    this->connections--;
+}
+
+net::awaitable<AdmissionControl::Ticket>
+AdmissionControl::admit(Deadline deadline, bool& queued) {
+    // Read before locking, so that nothing is awaited under the mutex.
+    auto executor = co_await net::this_coro::executor;
+    auto waiter = std::make_shared<Waiter>();
+    {
+        std::lock_guard lock(this->mutex);
+        if (this->requests < this->max_requests) {
+            this->requests++;
+            co_return Ticket(this);
+        }
+        if (this->queue.size() >= this->queue_size) {
+            co_return Ticket();
+        }
+        waiter->timer = std::make_shared<net::steady_timer>(executor, deadline);
+        this->queue.push_back(waiter);
+    }
+    queued = true;
+
+    // Woken up early by `release` when a slot is handed over.
+    boost::system::error_code ec;
+    co_await waiter->timer->async_wait(
+        net::redirect_error(net::use_awaitable, ec));
+
+    std::lock_guard lock(this->mutex);
+    if (waiter->granted) {
+        co_return Ticket(this);
+    }
+    std::erase(this->queue, waiter);
+    co_return Ticket();
+}
+
+void AdmissionControl::release() {
+    std::lock_guard lock(this->mutex);
+    if (this->queue.empty()) {
+        this->requests--;
+        return;
+    }
+    // The slot passes to the waiter, so `requests` stays the same.
+    std::shared_ptr<Waiter> waiter = std::move(this->queue.front());
+    this->queue.pop_front();
+    waiter->granted = true;
+    auto timer = waiter->timer;
+    net::post(timer->get_executor(), [timer] { timer->cancel(); });
+}
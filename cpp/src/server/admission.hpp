@@ -0,0 +1,110 @@
+#pragma once
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "deadline.hpp"
+
+// Resource limits of the HTTP server.
+struct ServerLimits {
+    size_t max_connections;
+    // Requests handled at the same time.
+    size_t max_requests;
+    // Requests allowed to wait for a free request slot; beyond that they
+    // are shed with 503.
+    size_t queue_size;
+    // Time a keep-alive connection may stay silent between requests.
+    std::chrono::milliseconds idle_timeout;
+    // Time to receive a whole request once its first bytes arrived.
+    std::chrono::milliseconds read_timeout;
+    std::chrono::milliseconds write_timeout;
+    // Budget of one request, including the time it spends queued.
+    std::chrono::milliseconds request_deadline;
+    // Sent in `Retry-After` with every shed request.
+    std::chrono::seconds retry_after;
+};
+
+ServerLimits server_limits(const boost::program_options::variables_map& vm);
+
+// Bounds the connections and requests of one shard.
+//
+// Up to `max_requests` requests run at once. Further requests wait in a
+// FIFO queue of at most `queue_size` entries for a slot to free up, or
+// until their deadline passes. When the queue is full they are rejected
+// right away, so overload shows up as fast 503s rather than as growing
+// latency for everyone.
+class AdmissionControl {
+  public:
+    AdmissionControl(size_t max_connections, size_t max_requests,
+                     size_t queue_size);
+
+    AdmissionControl(const AdmissionControl& other) = delete;
+
+    // Claims a connection slot. Returns false when all are taken.
+    bool open_connection();
+
+    void close_connection();
+
+    // A request slot, released when the ticket is destroyed. An empty
+    // ticket means the request was not admitted.
+    class Ticket {
+      public:
+        Ticket() = default;
+
+        explicit Ticket(AdmissionControl* owner) : owner(owner) {}
+
+        Ticket(const Ticket& other) = delete;
+
+        Ticket(Ticket&& other) : owner(other.owner) { other.owner = nullptr; }
+
+        Ticket& operator=(Ticket&& other) {
+            if (this != &other) {
+                if (this->owner) {
+                    this->owner->release();
+                }
+                this->owner = other.owner;
+                other.owner = nullptr;
+            }
+            return *this;
+        }
+
+        ~Ticket() {
+            if (this->owner) {
+                this->owner->release();
+            }
+        }
+
+        explicit operator bool() const { return this->owner != nullptr; }
+
+      private:
+        AdmissionControl* owner = nullptr;
+    };
+
+    // Admits one request, queueing it while all slots are taken. Sets
+    // `queued` if the request had to wait.
+    boost::asio::awaitable<Ticket> admit(Deadline deadline, bool& queued);
+
+  private:
+    struct Waiter {
+        std::shared_ptr<boost::asio::steady_timer> timer;
+        bool granted = false;
+    };
+
+    // Hands the slot to the oldest waiter, or frees it.
+    void release();
+
+    const size_t max_connections;
+    const size_t max_requests;
+    const size_t queue_size;
+
+    std::mutex mutex;
+    size_t connections = 0;
+    size_t requests = 0;
+    std::deque<std::shared_ptr<Waiter>> queue;
+};
@@ -0,0 +1,80 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <utility>
+
+#include "arena.hpp"
+
+std::unique_ptr<std::byte[]> ArenaPool::acquire() {
+    {
+        std::lock_guard lock(this->mutex);
+        if (!this->idle.empty()) {
+            std::unique_ptr<std::byte[]> buffer = std::move(this->idle.back());
+            this->idle.pop_back();
+            return buffer;
+        }
+    }
+    return std::make_unique_for_overwrite<std::byte[]>(buffer_size);
+}
+
+void ArenaPool::release(std::unique_ptr<std::byte[]> buffer) {
+    std::lock_guard lock(this->mutex);
+    if (this->idle.size() < this->max_idle) {
+        this->idle.push_back(std::move(buffer));
+    }
+}
+
+RequestArena::RequestArena(ArenaPool& pool,
+                           std::atomic<uint64_t>& heap_blocks)
+    : pool(pool), buffer(pool.acquire()), upstream(heap_blocks),
+      memory(this->buffer.get(), ArenaPool::buffer_size, &this->upstream),
+      json_resource(this->memory) {}
+
+RequestArena::~RequestArena() {
+    this->memory.release();
+    this->pool.release(std::move(this->buffer));
+}
+
+void* RequestArena::Upstream::do_allocate(size_t bytes, size_t alignment) {
+    this->blocks.fetch_add(1, std::memory_order_relaxed);
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void RequestArena::Upstream::do_deallocate(void* p, size_t bytes,
+                                           size_t alignment) {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+#ifdef CAREPET_COUNT_ALLOCATIONS
+
+static std::atomic<uint64_t> allocation_count{0};
+
+// The array forms of new and delete end up here too; over-aligned
+// allocations are not counted.
+void* operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size != 0 ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+std::optional<uint64_t> heap_allocations() {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+#else
+
+std::optional<uint64_t> heap_allocations() { return std::nullopt; }
+
+#endif
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <atomic>
+#include <boost/beast/http.hpp>
+#include <boost/json.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace http = boost::beast::http;
+
+// Allocator of the memory of a request, see `RequestArena`. Like
+// `std::pmr::polymorphic_allocator`, but assignable, which Beast's fields
+// require.
+template <class T> class ArenaAllocator {
+  public:
+    using value_type = T;
+
+    ArenaAllocator() noexcept : memory(std::pmr::get_default_resource()) {}
+
+    ArenaAllocator(std::pmr::memory_resource* memory) noexcept
+        : memory(memory) {}
+
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept
+        : memory(other.resource()) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(
+            this->memory->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        this->memory->deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    std::pmr::memory_resource* resource() const noexcept {
+        return this->memory;
+    }
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept {
+        return *this->memory == *other.resource();
+    }
+
+  private:
+    std::pmr::memory_resource* memory;
+};
+
+using ArenaFields = http::basic_fields<ArenaAllocator<char>>;
+using ArenaBody = http::basic_string_body<char, std::char_traits<char>,
+                                          ArenaAllocator<char>>;
+
+// A string in an arena, like the bodies of messages.
+using ArenaString = ArenaBody::value_type;
+
+// Deleter of objects made by `arena_new`. Only destroys them: their
+// memory goes with the arena.
+struct ArenaDelete {
+    template <class T> void operator()(T* p) const { std::destroy_at(p); }
+};
+
+// An object owned like by `std::unique_ptr`, in the memory of an arena. It
+// must be gone before the arena is.
+template <class T> using ArenaPtr = std::unique_ptr<T, ArenaDelete>;
+
+template <class T, class... Args>
+ArenaPtr<T> arena_new(std::pmr::memory_resource* memory, Args&&... args) {
+    void* p = memory->allocate(sizeof(T), alignof(T));
+    return ArenaPtr<T>(new (p) T(std::forward<Args>(args)...));
+}
+
+// Messages of the server. Their fields and bodies live in the arena of
+// the connection they belong to; default constructed ones use the heap.
+using Request = http::request<ArenaBody, ArenaFields>;
+using ResponseMessage = http::response<ArenaBody, ArenaFields>;
+
+// Buffers for arenas, recycled between requests so that a new request
+// does not need to allocate one. Thread safe.
+class ArenaPool {
+  public:
+    static constexpr size_t buffer_size = 64 * 1024;
+
+    // Keeps at most `max_idle` buffers around.
+    explicit ArenaPool(size_t max_idle) : max_idle(max_idle) {}
+
+    ArenaPool(const ArenaPool& other) = delete;
+
+    std::unique_ptr<std::byte[]> acquire();
+
+    void release(std::unique_ptr<std::byte[]> buffer);
+
+  private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<std::byte[]>> idle;
+    size_t max_idle;
+};
+
+// Memory for one request of a connection: the request, the response, the
+// JSON values built for it and the handlers' scratch containers.
+// Allocating bumps a pointer through a buffer from the pool and
+// deallocating does nothing; destroying the arena frees everything at
+// once and gives the buffer back to the pool. A request that outgrows the
+// buffer continues in blocks from the heap, which are returned with it.
+// Not thread safe.
+class RequestArena {
+  public:
+    // Counts the blocks taken from the heap in `heap_blocks`.
+    RequestArena(ArenaPool& pool, std::atomic<uint64_t>& heap_blocks);
+
+    RequestArena(const RequestArena& other) = delete;
+
+    ~RequestArena();
+
+    std::pmr::memory_resource* resource() { return &this->memory; }
+
+    // The arena as Boost.JSON storage. Values built on it must not outlive
+    // the arena.
+    boost::json::storage_ptr storage() {
+        return boost::json::storage_ptr(&this->json_resource);
+    }
+
+  private:
+    // Forwards to the heap, counting the blocks taken from it.
+    class Upstream : public std::pmr::memory_resource {
+      public:
+        explicit Upstream(std::atomic<uint64_t>& blocks) : blocks(blocks) {}
+
+      private:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const
+            noexcept override {
+            return this == &other;
+        }
+
+        std::atomic<uint64_t>& blocks;
+    };
+
+    // Boost.JSON has its own memory_resource interface.
+    class JsonResource : public boost::json::memory_resource {
+      public:
+        explicit JsonResource(std::pmr::memory_resource& arena)
+            : arena(arena) {}
+
+      private:
+        void* do_allocate(size_t bytes, size_t alignment) override {
+            return this->arena.allocate(bytes, alignment);
+        }
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        }
+        bool do_is_equal(const boost::json::memory_resource& other) const
+            noexcept override {
+            return this == &other;
+        }
+
+        std::pmr::memory_resource& arena;
+    };
+
+    ArenaPool& pool;
+    std::unique_ptr<std::byte[]> buffer;
+    Upstream upstream;
+    std::pmr::monotonic_buffer_resource memory;
+    JsonResource json_resource;
+};
+
+// Heap allocations made through the global operator new since the
+// program started. Only counted in builds with CAREPET_COUNT_ALLOCATIONS;
+// empty otherwise.
+std::optional<uint64_t> heap_allocations();
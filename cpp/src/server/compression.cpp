@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <boost/system/error_code.hpp>
+#include <format>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <zlib.h>
+
+#include "compression.hpp"
+#include "header_values.hpp"
+
+namespace beast = boost::beast;
+
+CompressionConfig
+compression_config(const boost::program_options::variables_map& vm) {
+    return CompressionConfig{
+        .min_size = vm["compress-min-bytes"].as<size_t>(),
+        .level = std::clamp(vm["compress-level"].as<int>(), 0, 9),
+    };
+}
+
+std::optional<ContentEncoding> negotiate_encoding(std::string_view accept) {
+    double gzip = 0;
+    double deflate = 0;
+    double any = 0;
+    bool gzip_listed = false;
+    bool deflate_listed = false;
+    while (!accept.empty()) {
+        size_t comma = accept.find(',');
+        std::string_view element = accept.substr(0, comma);
+        accept.remove_prefix(comma == std::string_view::npos ? accept.size()
+                                                             : comma + 1);
+
+        std::string_view coding =
+            trim_whitespace(element.substr(0, element.find(';')));
+        double q = accept_quality(element);
+        if (iequals(coding, "gzip") || iequals(coding, "x-gzip")) {
+            gzip = q;
+            gzip_listed = true;
+        } else if (iequals(coding, "deflate")) {
+            deflate = q;
+            deflate_listed = true;
+        } else if (coding == "*") {
+            any = q;
+        }
+    }
+    // "*" covers the codings not listed by name.
+    if (!gzip_listed) {
+        gzip = any;
+    }
+    if (!deflate_listed) {
+        deflate = any;
+    }
+
+    if (gzip > 0 && gzip >= deflate) {
+        return ContentEncoding::gzip;
+    }
+    if (deflate > 0) {
+        return ContentEncoding::deflate;
+    }
+    return std::nullopt;
+}
+
+std::optional<ContentEncoding>
+choose_encoding(const Request& req, ResponseMessage& res, bool streamed,
+                const CompressionConfig& config) {
+    if (config.level == 0 ||
+        (!streamed && (res.body().empty() ||
+                       res.body().size() < config.min_size)) ||
+        req.version() < 11 || res.count(http::field::content_encoding)) {
+        return std::nullopt;
+    }
+    beast::string_view vary = res[http::field::vary];
+    if (vary.empty()) {
+        res.set(http::field::vary, "Accept-Encoding");
+    } else {
+        ArenaString combined(vary.data(), vary.size(), res.get_allocator());
+        combined += ", Accept-Encoding";
+        res.set(http::field::vary,
+                beast::string_view(combined.data(), combined.size()));
+    }
+    beast::string_view accept = req[http::field::accept_encoding];
+    return negotiate_encoding({accept.data(), accept.size()});
+}
+
+static std::string_view encoding_name(ContentEncoding encoding) {
+    return encoding == ContentEncoding::gzip ? "gzip" : "deflate";
+}
+
+void tag_encoding(ArenaFields& fields, ContentEncoding encoding) {
+    beast::string_view etag = fields[http::field::etag];
+    if (etag.size() < 2 || etag.back() != '"') {
+        return;
+    }
+    ArenaString tagged(etag.data(), etag.size() - 1, fields.get_allocator());
+    tagged += '-';
+    tagged += encoding_name(encoding);
+    tagged += '"';
+    fields.set(http::field::etag,
+               beast::string_view(tagged.data(), tagged.size()));
+}
+
+std::string_view untag_encoding(std::string_view opaque) {
+    for (ContentEncoding encoding :
+         {ContentEncoding::gzip, ContentEncoding::deflate}) {
+        std::string_view name = encoding_name(encoding);
+        if (opaque.size() > name.size() && opaque.ends_with(name) &&
+            opaque[opaque.size() - name.size() - 1] == '-') {
+            return opaque.substr(0, opaque.size() - name.size() - 1);
+        }
+    }
+    return opaque;
+}
+
+Deflater::Deflater(ContentEncoding encoding, int level) {
+    // gzip wraps the deflate stream in a gzip header, HTTP's "deflate"
+    // in a zlib one.
+    int window_bits = encoding == ContentEncoding::gzip ? 15 + 16 : 15;
+    if (deflateInit2(&this->stream, level, Z_DEFLATED, window_bits, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error(
+            std::format("Failed to initialize zlib: {}",
+                        this->stream.msg ? this->stream.msg : "no memory"));
+    }
+}
+
+Deflater::~Deflater() { deflateEnd(&this->stream); }
+
+void Deflater::input(std::string_view in) {
+    // zlib never writes through next_in.
+    this->stream.next_in =
+        reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    this->stream.avail_in = in.size();
+}
+
+size_t Deflater::deflate_to(char* out, size_t room, int flush) {
+    this->stream.next_out = reinterpret_cast<Bytef*>(out);
+    this->stream.avail_out = room;
+    if (deflate(&this->stream, flush) == Z_STREAM_ERROR) {
+        throw std::runtime_error("zlib stream error");
+    }
+    return this->stream.avail_out;
+}
+
+void deflate_body::writer::init(beast::error_code& ec) {
+    try {
+        this->deflater.emplace(this->body.encoding, this->body.level);
+        ec = {};
+    } catch (const std::exception&) {
+        ec = boost::system::errc::make_error_code(
+            boost::system::errc::not_enough_memory);
+    }
+}
+
+boost::optional<std::pair<deflate_body::writer::const_buffers_type, bool>>
+deflate_body::writer::get(beast::error_code& ec) {
+    constexpr size_t slice = 16 * 1024;
+
+    ec = {};
+    if (this->finished) {
+        return boost::none;
+    }
+
+    // zlib may swallow a slice without output; an empty buffer would end
+    // the chunked body, so keep feeding it.
+    this->buffer.clear();
+    try {
+        while (this->buffer.empty()) {
+            std::string_view in =
+                std::string_view(this->body.source).substr(this->offset, slice);
+            this->offset += in.size();
+            this->finished = this->offset == this->body.source.size();
+            this->deflater->compress(in, this->finished ? Z_FINISH : Z_NO_FLUSH,
+                                     this->buffer);
+            if (this->finished) {
+                break;
+            }
+        }
+    } catch (const std::exception&) {
+        ec = boost::system::errc::make_error_code(
+            boost::system::errc::io_error);
+        return boost::none;
+    }
+    return std::make_pair(
+        const_buffers_type(this->buffer.data(), this->buffer.size()),
+        !this->finished);
+}
+
+http::response<deflate_body, ArenaFields>
+compress(ResponseMessage&& res, ContentEncoding encoding, int level) {
+    http::response<deflate_body, ArenaFields> compressed{
+        std::move(res.base()),
+        deflate_body::value_type{
+            .source = std::move(res.body()),
+            .encoding = encoding,
+            .level = level,
+        }};
+    compressed.set(http::field::content_encoding,
+                   encoding == ContentEncoding::gzip ? "gzip" : "deflate");
+    tag_encoding(compressed.base(), encoding);
+    compressed.erase(http::field::content_length);
+    compressed.chunked(true);
+    return compressed;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/optional.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <zlib.h>
+
+#include "arena.hpp"
+
+namespace http = boost::beast::http;
+
+enum class ContentEncoding { gzip, deflate };
+
+struct CompressionConfig {
+    // Responses with smaller bodies go out uncompressed.
+    size_t min_size;
+    // zlib compression level, 1 (fastest) to 9 (smallest). 0 turns
+    // compression off.
+    int level;
+};
+
+CompressionConfig
+compression_config(const boost::program_options::variables_map& vm);
+
+// Picks the encoding for a response from the request's `Accept-Encoding`
+// header, preferring gzip. Empty if the client accepts neither.
+std::optional<ContentEncoding> negotiate_encoding(std::string_view accept);
+
+// Encoding to send `res` with, or empty to send it as is. Only non-empty
+// bodies of at least `config.min_size` bytes are compressed, and only for
+// HTTP/1.1 clients, which can take a chunked response. A `streamed` body
+// has no size up front and is compressed whatever its size. Adds `Vary`
+// to `res` when the choice depended on the request.
+std::optional<ContentEncoding>
+choose_encoding(const Request& req, ResponseMessage& res, bool streamed,
+                const CompressionConfig& config);
+
+// Marks the ETag of `fields`, if any, as one of the `encoding`
+// representation: a strong ETag must differ between encodings.
+void tag_encoding(ArenaFields& fields, ContentEncoding encoding);
+
+// The opaque part of an entity tag, between the quotes, without the mark
+// of `tag_encoding`.
+std::string_view untag_encoding(std::string_view opaque);
+
+// Incremental zlib compressor producing a gzip or deflate stream.
+class Deflater {
+  public:
+    Deflater(ContentEncoding encoding, int level);
+
+    Deflater(const Deflater& other) = delete;
+
+    ~Deflater();
+
+    // Compresses `in` and appends the output to `out`, a string of any
+    // allocator. `flush` is the zlib flush mode: Z_NO_FLUSH may hold
+    // output back, Z_SYNC_FLUSH emits everything passed so far, Z_FINISH
+    // ends the stream.
+    template <class String>
+    void compress(std::string_view in, int flush, String& out) {
+        this->input(in);
+        // A full output buffer means zlib may have more to say.
+        size_t left;
+        do {
+            size_t offset = out.size();
+            size_t room = std::max<size_t>(in.size() / 2, 4096);
+            out.resize(offset + room);
+            left = this->deflate_to(out.data() + offset, room, flush);
+            out.resize(offset + room - left);
+        } while (left == 0);
+    }
+
+  private:
+    void input(std::string_view in);
+
+    // Compresses into the `room` bytes at `out`. Returns how many of them
+    // are left unused.
+    size_t deflate_to(char* out, size_t room, int flush);
+
+    z_stream stream{};
+};
+
+// Body that holds an uncompressed string and compresses it while it is
+// serialized, one slice at a time. The compressed body never exists in
+// full, so its length is unknown up front and it is sent chunked.
+struct deflate_body {
+    struct value_type {
+        ArenaBody::value_type source;
+        ContentEncoding encoding;
+        int level;
+    };
+
+    class writer {
+      public:
+        using const_buffers_type = boost::asio::const_buffer;
+
+        template <bool isRequest, class Fields>
+        writer(const http::header<isRequest, Fields>&, const value_type& body)
+            : body(body), buffer(body.source.get_allocator()) {}
+
+        void init(boost::beast::error_code& ec);
+
+        boost::optional<std::pair<const_buffers_type, bool>>
+        get(boost::beast::error_code& ec);
+
+      private:
+        const value_type& body;
+        std::optional<Deflater> deflater;
+        size_t offset = 0;
+        bool finished = false;
+        // In the arena of the body.
+        ArenaString buffer;
+    };
+};
+
+// Moves the body of `res` into a response that compresses it with
+// `encoding` on the way out.
+http::response<deflate_body, ArenaFields>
+compress(ResponseMessage&& res, ContentEncoding encoding, int level);
@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <boost/asio/awaitable.hpp>
+#include <cassandra.h>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "downsampling.hpp"
+
+namespace net = boost::asio;
+
+std::optional<Downsampling> parse_downsampling(std::string_view name) {
+    for (Downsampling method : {Downsampling::avg, Downsampling::min,
+                                Downsampling::max, Downsampling::lttb}) {
+        if (name == downsampling_name(method)) {
+            return method;
+        }
+    }
+    return std::nullopt;
+}
+
+std::string_view downsampling_name(Downsampling method) {
+    switch (method) {
+    case Downsampling::min:
+        return "min";
+    case Downsampling::max:
+        return "max";
+    case Downsampling::lttb:
+        return "lttb";
+    case Downsampling::avg:
+        break;
+    }
+    return "avg";
+}
+
+std::optional<cass_int64_t> parse_step(std::string_view step) {
+    cass_int64_t count = 0;
+    auto [end, ec] =
+        std::from_chars(step.data(), step.data() + step.size(), count);
+    if (ec != std::errc() || count <= 0) {
+        return std::nullopt;
+    }
+    std::string_view unit(end, step.data() + step.size() - end);
+    struct Unit {
+        std::string_view name;
+        cass_int64_t ms;
+    };
+    static constexpr Unit units[] = {
+        {"ms", 1}, {"s", 1000}, {"m", 60'000}, {"h", 3'600'000},
+        {"d", 86'400'000},
+    };
+    for (const Unit& u : units) {
+        if (unit == u.name) {
+            if (count > std::numeric_limits<cass_int64_t>::max() / u.ms) {
+                return std::nullopt;
+            }
+            return count * u.ms;
+        }
+    }
+    return std::nullopt;
+}
+
+// Reads `source` until it has whole buckets to return, so that every
+// page of the downsampled series is final.
+class DownsampledStream : public MeasurementStream {
+  public:
+    DownsampledStream(std::unique_ptr<MeasurementStream> source,
+                      cass_int64_t from, cass_int64_t width)
+        : source(std::move(source)), from(from), width(width) {}
+
+    net::awaitable<bool> next_page() override {
+        this->samples.clear();
+        while (this->samples.empty() && !this->exhausted) {
+            bool has_page = co_await this->source->next_page();
+            if (has_page) {
+                this->fold(this->source->page());
+            } else {
+                this->finish();
+                this->exhausted = true;
+            }
+        }
+        co_return !this->samples.empty();
+    }
+
+    std::span<const Sample> page() const override { return this->samples; }
+
+  protected:
+    // Takes in a page of `source`, appending the points of the buckets
+    // it completes to `samples`.
+    virtual void fold(std::span<const Sample> page) = 0;
+
+    // Appends the points of the buckets still open.
+    virtual void finish() = 0;
+
+    // Measurements of the range are never before `from`.
+    cass_int64_t bucket_of(cass_int64_t ts) const {
+        return (ts - this->from) / this->width;
+    }
+
+    cass_int64_t bucket_start(cass_int64_t bucket) const {
+        return this->from + bucket * this->width;
+    }
+
+    std::vector<Sample> samples;
+
+  private:
+    std::unique_ptr<MeasurementStream> source;
+    cass_int64_t from;
+    cass_int64_t width;
+    bool exhausted = false;
+};
+
+class BucketStream : public DownsampledStream {
+  public:
+    BucketStream(std::unique_ptr<MeasurementStream> source,
+                 Downsampling method, cass_int64_t from, cass_int64_t width)
+        : DownsampledStream(std::move(source), from, width), method(method) {
+    }
+
+  protected:
+    void fold(std::span<const Sample> page) override {
+        // Pages are in `ts` order, so each bucket is one run of samples,
+        // found by binary search and reduced in one pass.
+        auto it = page.begin();
+        while (it != page.end()) {
+            // Compares buckets rather than against the end of this one,
+            // which may not fit in int64.
+            cass_int64_t bucket = this->bucket_of(it->ts);
+            auto end = std::partition_point(
+                it, page.end(), [this, bucket](const Sample& s) {
+                    return this->bucket_of(s.ts) == bucket;
+                });
+            if (bucket != this->bucket && this->count > 0) {
+                this->flush();
+            }
+            this->bucket = bucket;
+            this->reduce(std::span<const Sample>(it, end));
+            it = end;
+        }
+    }
+
+    void finish() override {
+        if (this->count > 0) {
+            this->flush();
+        }
+    }
+
+  private:
+    // Folds a run of samples into the accumulators of the bucket. The
+    // four partial sums and branch-free min/max carry no dependency from
+    // one sample to the next, so the loop pipelines and vectorizes.
+    void reduce(std::span<const Sample> run) {
+        float lo = this->lo;
+        float hi = this->hi;
+        double sums[4] = {0, 0, 0, 0};
+        size_t n = run.size();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            for (size_t k = 0; k < 4; k++) {
+                float v = run[i + k].value;
+                lo = v < lo ? v : lo;
+                hi = v > hi ? v : hi;
+                sums[k] += v;
+            }
+        }
+        for (; i < n; i++) {
+            float v = run[i].value;
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+            sums[0] += v;
+        }
+        this->lo = lo;
+        this->hi = hi;
+        this->sum += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+        this->count += n;
+    }
+
+    void flush() {
+        float value = this->method == Downsampling::min   ? this->lo
+                      : this->method == Downsampling::max ? this->hi
+                                                          : float(this->sum /
+                                                                  this->count);
+        this->samples.push_back(
+            Sample{.ts = this->bucket_start(this->bucket), .value = value});
+        this->lo = std::numeric_limits<float>::infinity();
+        this->hi = -std::numeric_limits<float>::infinity();
+        this->sum = 0;
+        this->count = 0;
+    }
+
+    Downsampling method;
+    cass_int64_t bucket = 0;
+    float lo = std::numeric_limits<float>::infinity();
+    float hi = -std::numeric_limits<float>::infinity();
+    double sum = 0;
+    size_t count = 0;
+};
+
+// LTTB over buckets of time rather than of count, since the number of
+// measurements is unknown until the end. The first and last measurements
+// are always kept.
+//
+// The area of a triangle with two fixed corners is linear in the third
+// corner, so its largest value over a bucket is found at a vertex of the
+// bucket's convex hull in (ts, value). A bucket keeps only the vertices
+// of its hull, built as the measurements arrive in `ts` order, which
+// gives the same choice as keeping every measurement. A chain of the hull
+// that grows past `max_chain` vertices is thinned, so that a bucket takes
+// bounded memory however wide it is.
+class LttbStream : public DownsampledStream {
+  public:
+    using DownsampledStream::DownsampledStream;
+
+  protected:
+    void fold(std::span<const Sample> page) override {
+        for (const Sample& sample : page) {
+            if (!this->started) {
+                this->started = true;
+                this->choose(sample);
+                continue;
+            }
+            cass_int64_t bucket = this->bucket_of(sample.ts);
+            if (this->current.empty() ||
+                (this->next.empty() && bucket == this->current.index)) {
+                this->current.index = bucket;
+                this->current.add(sample);
+            } else if (this->next.empty() || bucket == this->next.index) {
+                this->next.index = bucket;
+                this->next.add(sample);
+            } else {
+                // The next bucket is complete, so its average is known.
+                this->choose_from(this->current, this->next.average());
+                std::swap(this->current, this->next);
+                this->next.clear();
+                this->next.index = bucket;
+                this->next.add(sample);
+            }
+        }
+    }
+
+    void finish() override {
+        Bucket& tail = this->next.empty() ? this->current : this->next;
+        if (tail.empty()) {
+            return;
+        }
+        Sample last = tail.take_latest();
+        if (!this->current.empty()) {
+            this->choose_from(this->current, this->next.empty()
+                                                 ? last
+                                                 : this->next.average());
+        }
+        if (!this->next.empty()) {
+            this->choose_from(this->next, last);
+        }
+        this->choose(last);
+    }
+
+  private:
+    // Vertices kept per chain of a bucket's hull.
+    static constexpr size_t max_chain = 64;
+
+    // Measurements of one bucket: their count and sums, for the average,
+    // and the candidates for the point kept.
+    struct Bucket {
+        bool empty() const { return this->count == 0; }
+
+        void add(const Sample& sample) {
+            if (this->count == 0) {
+                this->first_ts = sample.ts;
+            }
+            if (this->latest) {
+                push(this->upper, *this->latest, true);
+                push(this->lower, *this->latest, false);
+            }
+            this->latest = sample;
+            this->count++;
+            this->ts_sum += double(sample.ts - this->first_ts);
+            this->value_sum += sample.value;
+        }
+
+        // Removes the latest measurement, which is left out of the hull
+        // so that it can be.
+        Sample take_latest() {
+            Sample sample = *this->latest;
+            this->latest.reset();
+            this->count--;
+            this->ts_sum -= double(sample.ts - this->first_ts);
+            this->value_sum -= sample.value;
+            return sample;
+        }
+
+        Sample average() const {
+            return Sample{
+                .ts = this->first_ts + cass_int64_t(this->ts_sum / this->count),
+                .value = float(this->value_sum / this->count)};
+        }
+
+        // Calls `f` with every measurement that may be chosen.
+        template <typename F> void for_each_candidate(F f) const {
+            for (const Sample& sample : this->upper) {
+                f(sample);
+            }
+            for (const Sample& sample : this->lower) {
+                f(sample);
+            }
+            if (this->latest) {
+                f(*this->latest);
+            }
+        }
+
+        // Keeps the capacity of the chains.
+        void clear() {
+            this->count = 0;
+            this->ts_sum = 0;
+            this->value_sum = 0;
+            this->upper.clear();
+            this->lower.clear();
+            this->latest.reset();
+        }
+
+        cass_int64_t index = 0;
+        size_t count = 0;
+        cass_int64_t first_ts = 0;
+        // Timestamps relative to `first_ts`, so that they keep their
+        // precision as doubles.
+        double ts_sum = 0;
+        double value_sum = 0;
+        // Upper and lower chains of the hull of the measurements but the
+        // latest, in `ts` order.
+        std::vector<Sample> upper;
+        std::vector<Sample> lower;
+        std::optional<Sample> latest;
+
+      private:
+        // Appends `sample` to a chain of Andrew's monotone chain
+        // algorithm, dropping the vertices it makes concave.
+        static void push(std::vector<Sample>& chain, const Sample& sample,
+                         bool upper) {
+            while (chain.size() >= 2) {
+                const Sample& o = chain[chain.size() - 2];
+                const Sample& a = chain.back();
+                double cross =
+                    double(a.ts - o.ts) * (double(sample.value) - o.value) -
+                    (double(a.value) - o.value) * double(sample.ts - o.ts);
+                if (upper ? cross < 0 : cross > 0) {
+                    break;
+                }
+                chain.pop_back();
+            }
+            chain.push_back(sample);
+            if (chain.size() > max_chain) {
+                thin(chain, upper);
+            }
+        }
+
+        // Drops every other inner vertex of `chain`, keeping its ends and
+        // its extreme value, the peak of an upper chain or the trough of
+        // a lower one. What is left is still convex.
+        static void thin(std::vector<Sample>& chain, bool upper) {
+            auto extreme = upper ? std::max_element(chain.begin(), chain.end(),
+                                                    by_value)
+                                 : std::min_element(chain.begin(), chain.end(),
+                                                    by_value);
+            size_t keep = extreme - chain.begin();
+            size_t out = 1;
+            for (size_t i = 1; i + 1 < chain.size(); i++) {
+                if (i % 2 == 0 || i == keep) {
+                    chain[out++] = chain[i];
+                }
+            }
+            chain[out++] = chain.back();
+            chain.resize(out);
+        }
+
+        static bool by_value(const Sample& a, const Sample& b) {
+            return a.value < b.value;
+        }
+    };
+
+    // Keeps the sample of `bucket` that spans the largest triangle with
+    // the sample kept before and `c`.
+    void choose_from(const Bucket& bucket, Sample c) {
+        const Sample& a = this->chosen;
+        // Relative to `a`, so that millisecond timestamps keep their
+        // precision as doubles.
+        double cx = double(c.ts - a.ts);
+        double cy = double(c.value) - a.value;
+        Sample best{};
+        double best_area = -1;
+        bucket.for_each_candidate([&](const Sample& b) {
+            double bx = double(b.ts - a.ts);
+            double by = double(b.value) - a.value;
+            double area = std::abs(bx * cy - cx * by);
+            if (area > best_area) {
+                best = b;
+                best_area = area;
+            }
+        });
+        this->choose(best);
+    }
+
+    void choose(const Sample& sample) {
+        this->chosen = sample;
+        this->samples.push_back(sample);
+    }
+
+    bool started = false;
+    Sample chosen{};
+    Bucket current;
+    Bucket next;
+};
+
+std::unique_ptr<MeasurementStream>
+downsample(std::unique_ptr<MeasurementStream> source, Downsampling method,
+           cass_int64_t from, cass_int64_t width) {
+    if (method == Downsampling::lttb) {
+        return std::make_unique<LttbStream>(std::move(source), from, width);
+    }
+    return std::make_unique<BucketStream>(std::move(source), method, from,
+                                          width);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cassandra.h>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+#include "storage.hpp"
+
+// How a downsampled series represents the measurements it replaces.
+enum class Downsampling {
+    // One point per bucket, at the bucket's start, with the average,
+    // smallest or largest value of the bucket.
+    avg,
+    min,
+    max,
+    // Largest-Triangle-Three-Buckets: the measurement of each bucket that
+    // spans the largest triangle with the point chosen before it and the
+    // average of the next bucket. Keeps the shape of the series, peaks
+    // included, with real measurements.
+    lttb,
+};
+
+std::optional<Downsampling> parse_downsampling(std::string_view name);
+
+std::string_view downsampling_name(Downsampling method);
+
+// Parses a duration such as "500ms", "30s", "5m", "1h" or "1d" into
+// milliseconds. Empty if `step` is not a positive duration.
+std::optional<cass_int64_t> parse_step(std::string_view step);
+
+// Downsamples `source`, a range starting at `from`, into buckets of
+// `width` milliseconds as it is read. Pages of the result hold whole
+// buckets; memory grows neither with the range nor with the width of a
+// bucket.
+std::unique_ptr<MeasurementStream>
+downsample(std::unique_ptr<MeasurementStream> source, Downsampling method,
+           cass_int64_t from, cass_int64_t width);
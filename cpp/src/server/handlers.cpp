@@ -1,216 +1,901 @@
+#include <algorithm>
+#include <array>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
 #include <boost/json.hpp>
+#include <boost/program_options.hpp>
 #include <boost/url.hpp>
 #include <cassandra.h>
+#include <charconv>
 #include <chrono>
-#include <iostream>
+#include <cstdint>
+#include <exception>
+#include <format>
+#include <iterator>
 #include <memory>
+#include <memory_resource>
 #include <optional>
-#include <sstream>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
-#include "database.hpp"
+#include "arena.hpp"
+#include "cache.hpp"
+#include "compression.hpp"
+#include "downsampling.hpp"
 #include "handlers.hpp"
 #include "json.hpp"
+#include "metrics.hpp"
 #include "model.hpp"
+#include "prometheus.hpp"
+#include "router.hpp"
+#include "sample_encoding.hpp"
+#include "single_flight.hpp"
+#include "storage.hpp"
 
 namespace beast = boost::beast;
 namespace http = boost::beast::http;
+namespace net = boost::asio;
+namespace po = boost::program_options;
+
+HandlerConfig handler_config(const po::variables_map& vm) {
+    return HandlerConfig{
+        .avg_cache_bytes = vm["avg-cache-mb"].as<size_t>() * 1024 * 1024,
+        .stream_page_timeout = std::chrono::milliseconds(
+            vm["stream-page-timeout-ms"].as<int64_t>()),
+    };
+}
+
+// Serializes `value` and appends it to `out`, reusing the buffers of
+// `sr`.
+template <class String>
+static void serialize_to(boost::json::serializer& sr,
+                         const boost::json::value& value, String& out) {
+    char buffer[4096];
+    sr.reset(&value);
+    while (!sr.done()) {
+        std::string_view piece = sr.read(buffer, sizeof(buffer));
+        out.append(piece.data(), piece.size());
+    }
+}
+
+// Bump when the JSON of immutable responses changes, so that cached
+// copies stop matching.
+static constexpr std::string_view etag_version = "1";
+
+// Strong ETag of an immutable `kind` of data of `id`, told apart by `key`,
+// in `memory`.
+static std::pmr::string immutable_etag(std::string_view kind, CassUuid id,
+                                       std::string_view key,
+                                       std::pmr::memory_resource* memory) {
+    char id_str[CASS_UUID_STRING_LENGTH];
+    cass_uuid_string(id, id_str);
+    std::pmr::string etag(memory);
+    std::format_to(std::back_inserter(etag), "\"{}.{}.{}.{}\"", kind, id_str,
+                   key, etag_version);
+    return etag;
+}
+
+// Whether the `If-None-Match` header `header` lists `etag`, a quoted
+// tag. Compares weakly, as RFC 9110 asks for this header, and sees
+// through the mark that compression puts on tags.
+static bool if_none_match(beast::string_view header, std::string_view etag) {
+    std::string_view list(header.data(), header.size());
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view tag = list.substr(0, comma);
+        list.remove_prefix(comma == std::string_view::npos ? list.size()
+                                                           : comma + 1);
+        while (!tag.empty() && (tag.front() == ' ' || tag.front() == '\t')) {
+            tag.remove_prefix(1);
+        }
+        while (!tag.empty() && (tag.back() == ' ' || tag.back() == '\t')) {
+            tag.remove_suffix(1);
+        }
+        if (tag == "*") {
+            return true;
+        }
+        if (tag.starts_with("W/")) {
+            tag.remove_prefix(2);
+        }
+        if (tag.size() >= 2 && tag.front() == '"' && tag.back() == '"' &&
+            untag_encoding(tag.substr(1, tag.size() - 2)) ==
+                etag.substr(1, etag.size() - 2)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Marks `res` as never changing, so that browsers and caches may keep it
+// for a year without revalidating.
+static void set_immutable(ResponseMessage& res, beast::string_view etag) {
+    res.set(http::field::etag, etag);
+    res.set(http::field::cache_control,
+            "public, max-age=31536000, immutable");
+}
 
 class ResponseFactory {
   public:
-    ResponseFactory(const http::request<http::string_body>& req) : req(req) {}
+    ResponseFactory(const Request& req, RequestArena& arena)
+        : req(req), arena(arena) {}
 
     ~ResponseFactory() = default;
 
-    http::response<http::string_body>
-    serverError(beast::string_view why) const {
-        http::response<http::string_body> res{
-            http::status::internal_server_error, req.version()};
-        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    // Storage for JSON values and containers built for the response.
+    boost::json::storage_ptr storage() const { return this->arena.storage(); }
+
+    std::pmr::memory_resource* resource() const {
+        return this->arena.resource();
+    }
+
+    ResponseMessage serverError(beast::string_view why) const {
+        ResponseMessage res = this->make(http::status::internal_server_error);
         res.set(http::field::content_type, "text/html");
-        res.keep_alive(req.keep_alive());
-        res.body() = std::string(why);
+        res.body().assign(why.data(), why.size());
         res.prepare_payload();
         return res;
     }
 
-    http::response<http::string_body> badRequest(beast::string_view why) const {
-        http::response<http::string_body> res{http::status::bad_request,
-                                              req.version()};
-        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    ResponseMessage badRequest(beast::string_view why) const {
+        ResponseMessage res = this->make(http::status::bad_request);
         res.set(http::field::content_type, "text/html");
-        res.keep_alive(req.keep_alive());
-        res.body() = std::string(why);
+        res.body().assign(why.data(), why.size());
         res.prepare_payload();
         return res;
     }
 
-    http::response<http::string_body>
-    notFound(beast::string_view target) const {
-        http::response<http::string_body> res{http::status::not_found,
-                                              req.version()};
-        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    ResponseMessage notFound(beast::string_view target) const {
+        ResponseMessage res = this->make(http::status::not_found);
         res.set(http::field::content_type, "text/html");
-        res.keep_alive(req.keep_alive());
-        res.body() =
-            "The resource '" + std::string(target) + "' was not found.";
+        res.body() = "The resource '";
+        res.body().append(target.data(), target.size());
+        res.body() += "' was not found.";
         res.prepare_payload();
         return res;
     }
 
-    http::response<http::string_body>
-    apiResponse(boost::json::value body) const {
-        http::response<http::string_body> res{http::status::ok, req.version()};
-        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    ResponseMessage methodNotAllowed(beast::string_view allow) const {
+        ResponseMessage res = this->make(http::status::method_not_allowed);
+        res.set(http::field::content_type, "text/html");
+        res.set(http::field::allow, allow);
+        res.body() = "Method not allowed";
+        res.prepare_payload();
+        return res;
+    }
+
+    ResponseMessage gatewayTimeout(beast::string_view why) const {
+        ResponseMessage res = this->make(http::status::gateway_timeout);
+        res.set(http::field::content_type, "text/html");
+        res.body().assign(why.data(), why.size());
+        res.prepare_payload();
+        return res;
+    }
+
+    ResponseMessage apiResponse(const boost::json::value& body) const {
+        ResponseMessage res = this->make(http::status::ok);
         res.set(http::field::content_type, "application/json");
-        res.keep_alive(req.keep_alive());
-        res.body() = boost::json::serialize(body);
+        boost::json::serializer sr(this->storage());
+        serialize_to(sr, body, res.body());
         res.prepare_payload();
         return res;
     }
 
+    // A JSON response with a body serialized beforehand.
+    ResponseMessage apiResponse(std::string_view json) const {
+        ResponseMessage res = this->make(http::status::ok);
+        res.set(http::field::content_type, "application/json");
+        res.body().assign(json.data(), json.size());
+        res.prepare_payload();
+        return res;
+    }
+
+    ResponseMessage metricsResponse(const std::string& body) const {
+        ResponseMessage res = this->make(http::status::ok);
+        res.set(http::field::content_type, PrometheusWriter::content_type);
+        res.body().assign(body.data(), body.size());
+        res.prepare_payload();
+        return res;
+    }
+
+    // Answers a conditional request for immutable data that the client
+    // already has. A 304 has neither a body nor a Content-Length.
+    ResponseMessage notModified(beast::string_view etag) const {
+        ResponseMessage res = this->make(http::status::not_modified);
+        set_immutable(res, etag);
+        return res;
+    }
+
+    Response apiStream(ArenaPtr<BodyStream> body) const {
+        ResponseMessage res = this->make(http::status::ok);
+        res.set(http::field::content_type, "application/json");
+        return Response(std::move(res), std::move(body));
+    }
+
+  private:
+    // A response to the request, with its header and body in the arena.
+    ResponseMessage make(http::status status) const {
+        ResponseMessage res{std::piecewise_construct,
+                            std::make_tuple(this->arena.resource()),
+                            std::make_tuple(this->arena.resource())};
+        res.result(status);
+        res.version(this->req.version());
+        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.keep_alive(this->req.keep_alive());
+        return res;
+    }
+
+    const Request& req;
+    RequestArena& arena;
+};
+
+// Measurements as a JSON array.
+class JsonSampleEncoder : public SampleEncoder {
+  public:
+    explicit JsonSampleEncoder(CassUuid sensor_id) : sensor_id(sensor_id) {}
+
+    void begin(std::string& out) override { out.push_back('['); }
+
+    void page(std::span<const Sample> samples, std::string& out) override {
+        for (const Sample& sample : samples) {
+            if (!this->first_row) {
+                out.push_back(',');
+            }
+            this->first_row = false;
+            Measure m{.sensor_id = this->sensor_id,
+                      .ts = sample.ts,
+                      .value = sample.value};
+            {
+                boost::json::value row = boost::json::value_from(
+                    m, boost::json::storage_ptr(&this->scratch));
+                serialize_to(this->serializer, row, out);
+            }
+            this->scratch.release();
+        }
+    }
+
+    void end(std::string& out) override { out.push_back(']'); }
+
+  private:
+    CassUuid sensor_id;
+    bool first_row = true;
+    // Rows are converted on `scratch`, which is emptied after each one,
+    // so a body of any length needs no allocation per row.
+    unsigned char scratch_buffer[1024];
+    boost::json::monotonic_resource scratch{this->scratch_buffer,
+                                            sizeof(this->scratch_buffer)};
+    // The serializer's stack, deep enough for a row.
+    unsigned char serializer_buffer[256];
+    boost::json::serializer serializer{boost::json::storage_ptr(),
+                                       this->serializer_buffer,
+                                       sizeof(this->serializer_buffer)};
+};
+
+// An encoder of `format` in `memory`.
+static ArenaPtr<SampleEncoder>
+sample_encoder(SampleFormat format, CassUuid sensor_id,
+               std::pmr::memory_resource* memory) {
+    switch (format) {
+    case SampleFormat::columnar:
+        return columnar_encoder(sensor_id, memory);
+    case SampleFormat::cbor:
+        return cbor_encoder(sensor_id, memory);
+    case SampleFormat::json:
+        break;
+    }
+    return arena_new<JsonSampleEncoder>(memory, sensor_id);
+}
+
+// Measurements of a sensor, encoded a few hundred rows of a storage page
+// at a time so that a piece stays small whatever the page size.
+class MeasurementBody : public BodyStream {
+  public:
+    static constexpr size_t rows_per_piece = 512;
+
+    // `has_page` tells whether `stream` already holds its first page.
+    MeasurementBody(std::unique_ptr<MeasurementStream> stream, bool has_page,
+                    ArenaPtr<SampleEncoder> encoder)
+        : stream(std::move(stream)), has_page(has_page),
+          encoder(std::move(encoder)) {}
+
+    net::awaitable<bool> next(std::string& out) override {
+        if (!this->started) {
+            this->encoder->begin(out);
+            this->started = true;
+        }
+        if (this->has_page) {
+            std::span<const Sample> rest =
+                this->stream->page().subspan(this->offset);
+            size_t rows = std::min(rest.size(), rows_per_piece);
+            this->encoder->page(rest.first(rows), out);
+            this->offset += rows;
+            if (this->offset == this->stream->page().size()) {
+                this->offset = 0;
+                this->has_page = co_await this->stream->next_page();
+            }
+        }
+        if (!this->has_page) {
+            this->encoder->end(out);
+            co_return false;
+        }
+        co_return true;
+    }
+
+  private:
+    std::unique_ptr<MeasurementStream> stream;
+    bool has_page;
+    // Rows of the current page already encoded.
+    size_t offset = 0;
+    ArenaPtr<SampleEncoder> encoder;
+    bool started = false;
+};
+
+// A day of averages of a sensor.
+struct SensorDay {
+    CassUuid sensor_id;
+    std::chrono::sys_days date;
+
+    bool operator==(const SensorDay& other) const {
+        return UuidEqual()(this->sensor_id, other.sensor_id) &&
+               this->date == other.date;
+    }
+};
+
+struct SensorDayHash {
+    size_t operator()(const SensorDay& key) const {
+        return UuidHash()(key.sensor_id) ^
+               size_t(key.date.time_since_epoch().count()) *
+                   0x9e3779b97f4a7c15ULL;
+    }
+};
+
+// The hourly averages of a day so far, from hour 0. Fixed in size, so
+// that handing it to the requests of a `SingleFlight` copies no heap
+// memory.
+struct DailyAverages {
+    std::array<float, 24> hours;
+    size_t count = 0;
+};
+
+// Waits for the first page of every stream at once, so that the wait takes
+// as long as the slowest stream rather than all of them in turn. Tells for
+// each stream whether it has a page, in `memory`.
+static net::awaitable<std::pmr::vector<bool>>
+first_pages(std::span<const std::unique_ptr<MeasurementStream>> streams,
+            std::pmr::memory_resource* memory) {
+    struct Pending {
+        Pending(size_t count, net::any_io_executor executor,
+                std::pmr::memory_resource* memory)
+            : count(count), has_page(count, memory), done(executor) {
+            this->done.expires_at(net::steady_timer::time_point::max());
+        }
+
+        size_t count;
+        std::pmr::vector<bool> has_page;
+        std::exception_ptr error;
+        net::steady_timer done;
+    };
+
+    // The fetches complete on this coroutine's executor, the strand of
+    // the connection, so `pending` needs no lock. All of them are done
+    // before this returns, so `pending` can live in `memory`.
+    auto executor = co_await net::this_coro::executor;
+    auto pending = std::allocate_shared<Pending>(
+        ArenaAllocator<Pending>(memory), streams.size(), executor, memory);
+    for (size_t i = 0; i < streams.size(); i++) {
+        net::co_spawn(executor, streams[i]->next_page(),
+                      [pending, i](std::exception_ptr error, bool has_page) {
+                          if (error) {
+                              pending->error = error;
+                          } else {
+                              pending->has_page[i] = has_page;
+                          }
+                          if (--pending->count == 0) {
+                              pending->done.cancel();
+                          }
+                      });
+    }
+    if (pending->count > 0) {
+        boost::system::error_code ec;
+        co_await pending->done.async_wait(
+            net::redirect_error(net::use_awaitable, ec));
+    }
+    if (pending->error) {
+        std::rethrow_exception(pending->error);
+    }
+    co_return std::move(pending->has_page);
+}
+
+// Measurements of all sensors of a pet as a JSON array with one
+// `{"sensor": ..., "measurements": [...]}` object per sensor, in the order
+// of `sensors`.
+class PetMeasurementBody : public BodyStream {
+  public:
+    // Takes over `streams`. The bodies of the sensors live in `memory`.
+    PetMeasurementBody(RecordSet<SensorView> sensors,
+                       std::span<std::unique_ptr<MeasurementStream>> streams,
+                       const std::pmr::vector<bool>& has_page,
+                       std::pmr::memory_resource* memory)
+        : sensors(std::move(sensors)), bodies(memory) {
+        this->bodies.reserve(streams.size());
+        for (size_t i = 0; i < streams.size(); i++) {
+            this->bodies.push_back(arena_new<MeasurementBody>(
+                memory, std::move(streams[i]), has_page[i],
+                arena_new<JsonSampleEncoder>(memory,
+                                             this->sensors.records[i].id)));
+        }
+    }
+
+    net::awaitable<bool> next(std::string& out) override {
+        if (!this->started) {
+            out.push_back('[');
+            this->started = true;
+        }
+        if (this->current == this->bodies.size()) {
+            out.push_back(']');
+            co_return false;
+        }
+        if (!this->in_sensor) {
+            if (this->current > 0) {
+                out.push_back(',');
+            }
+            out += "{\"sensor\":";
+            {
+                boost::json::value sensor = boost::json::value_from(
+                    this->sensors.records[this->current],
+                    boost::json::storage_ptr(&this->scratch));
+                serialize_to(this->serializer, sensor, out);
+            }
+            this->scratch.release();
+            out += ",\"measurements\":";
+            this->in_sensor = true;
+        }
+        if (!co_await this->bodies[this->current]->next(out)) {
+            out.push_back('}');
+            this->in_sensor = false;
+            this->current++;
+        }
+        co_return true;
+    }
+
   private:
-    const http::request<http::string_body>& req;
+    RecordSet<SensorView> sensors;
+    // One per sensor.
+    std::pmr::vector<ArenaPtr<MeasurementBody>> bodies;
+    size_t current = 0;
+    bool started = false;
+    // Whether the head of the current sensor's object is out.
+    bool in_sensor = false;
+    unsigned char scratch_buffer[1024];
+    boost::json::monotonic_resource scratch{this->scratch_buffer,
+                                            sizeof(this->scratch_buffer)};
+    unsigned char serializer_buffer[256];
+    boost::json::serializer serializer{boost::json::storage_ptr(),
+                                       this->serializer_buffer,
+                                       sizeof(this->serializer_buffer)};
 };
 
 class RequestHandler::Impl {
   public:
-    Impl(Database db)
-        : db(std::move(db)),
-          fetch_owner(this->db.prepare("SELECT owner_id, name, address FROM "
-                                       "carepet.owner WHERE owner_id = ?")),
-          fetch_pets(this->db.prepare(
-              "SELECT pet_id, owner_id, chip_id, species, "
-              "breed, color, gender, age, weight, address, name "
-              "FROM carepet.pet WHERE owner_id = ?")),
-          fetch_sensors(
-              this->db.prepare("SELECT sensor_id, pet_id, type "
-                               "FROM carepet.sensor WHERE pet_id = ?")),
-          fetch_measurements(
-              this->db.prepare("SELECT ts, value FROM carepet.measurement "
-                               "WHERE sensor_id = ? AND ts >= ? AND ts <= ?")),
-          fetch_avg(
-              this->db.prepare("SELECT hour, value FROM carepet.sensor_avg "
-                               "WHERE sensor_id = ? AND date = ?")),
-          insert_sensor_avg(this->db.prepare(
-              "INSERT INTO carepet.sensor_avg "
-              "(sensor_id, date, hour, value) VALUES (?, ?, ?, ?)")) {}
+    Impl(std::unique_ptr<Storage> storage, const ServerStats& stats,
+         const HandlerConfig& config);
 
     ~Impl() = default;
 
-    http::response<http::string_body>
-    handle_get_owner(const http::request<http::string_body>& req,
-                     const ResponseFactory& responses,
-                     std::string owner_id_str);
+    // Sets `route` to the route that matched.
+    net::awaitable<Response>
+    dispatch(const Request& req, const ResponseFactory& responses,
+             Deadline deadline, Route& route);
+
+    net::awaitable<Response>
+    handle_get_owner(const Request& req, const ResponseFactory& responses,
+                     Deadline deadline, const RouteParams& params);
 
-    http::response<http::string_body>
-    handle_get_pets(const http::request<http::string_body>& req,
-                    const ResponseFactory& responses, std::string owner_id_str);
+    net::awaitable<Response>
+    handle_get_pets(const Request& req, const ResponseFactory& responses,
+                    Deadline deadline, const RouteParams& params);
 
-    http::response<http::string_body>
-    handle_get_sensors(const http::request<http::string_body>& req,
-                       const ResponseFactory& responses,
-                       std::string pet_id_str);
+    net::awaitable<Response>
+    handle_get_sensors(const Request& req, const ResponseFactory& responses,
+                       Deadline deadline, const RouteParams& params);
 
-    http::response<http::string_body>
-    handle_get_measurements(const http::request<http::string_body>& req,
+    net::awaitable<Response>
+    handle_get_pet_measurements(const Request& req,
+                                const ResponseFactory& responses,
+                                Deadline deadline, const RouteParams& params);
+
+    net::awaitable<Response>
+    handle_get_measurements(const Request& req,
                             const ResponseFactory& responses,
-                            std::string sensor_id_str, std::string from,
-                            std::string to);
+                            Deadline deadline, const RouteParams& params);
+
+    net::awaitable<Response>
+    handle_get_sensor_avg(const Request& req, const ResponseFactory& responses,
+                          Deadline deadline, const RouteParams& params);
 
-    http::response<http::string_body>
-    handle_get_sensor_avg(const http::request<http::string_body>& req,
-                          const ResponseFactory& responses,
-                          std::string sensor_id_str, std::string date);
+    net::awaitable<Response>
+    handle_get_statement_stats(const Request& req,
+                               const ResponseFactory& responses,
+                               Deadline deadline, const RouteParams& params);
+
+    net::awaitable<Response>
+    handle_get_server_stats(const Request& req,
+                            const ResponseFactory& responses,
+                            Deadline deadline, const RouteParams& params);
+
+    net::awaitable<Response>
+    handle_get_metrics(const Request& req, const ResponseFactory& responses,
+                       Deadline deadline, const RouteParams& params);
+
+    std::vector<StatementStats> statement_stats() const {
+        return this->storage->statement_stats();
+    }
+
+    boost::json::value server_stats(boost::json::storage_ptr sp) const {
+        boost::json::array shards(sp);
+        for (size_t i = 0; i < this->stats.shard_count(); i++) {
+            const ShardStats& shard = this->stats.shard(i);
+            shards.push_back(boost::json::value(
+                {{"accepted", shard.accepted.load()},
+                 {"rejected_connections", shard.rejected_connections.load()},
+                 {"timed_out_connections", shard.timed_out_connections.load()},
+                 {"requests", shard.requests.load()},
+                 {"queued_requests", shard.queued_requests.load()},
+                 {"shed_requests", shard.shed_requests.load()},
+                 {"arena_heap_blocks", shard.arena_heap_blocks.load()}},
+                sp));
+        }
+        return boost::json::value({{"shards", std::move(shards)}}, sp);
+    }
+
+    std::string metrics() const;
 
   private:
-    void aggregate_missing_hours(
+    // The hourly averages of `date` so far, aggregating and storing the
+    // hours that are missing from storage. `scratch` allocates the
+    // averages while they are gathered.
+    net::awaitable<DailyAverages> daily_averages(
+        CassUuid sensor_id,
+        const std::chrono::time_point<std::chrono::system_clock>& now,
+        const std::chrono::year_month_day& date,
+        std::pmr::memory_resource* scratch, Deadline deadline);
+
+    net::awaitable<void> aggregate_missing_hours(
         CassUuid sensor_id,
         const std::chrono::time_point<std::chrono::system_clock>& now,
-        const std::chrono::year_month_day& date, std::vector<float>& data);
-
-    void group_by_hour(std::vector<float>& data,
-                       const std::vector<Measure>& measures, int current_hour,
-                       bool same_date);
-
-    void save_aggregated_data(CassUuid sensor_id,
-                              const std::chrono::year_month_day& date,
-                              const std::vector<float>& data, int prev_avg_size,
-                              bool same_date, int current_hour);
-
-    Database db;
-    PreparedStatement fetch_owner;
-    PreparedStatement fetch_pets;
-    PreparedStatement fetch_sensors;
-    PreparedStatement fetch_measurements;
-    PreparedStatement fetch_avg;
-    PreparedStatement insert_sensor_avg;
+        const std::chrono::year_month_day& date,
+        std::pmr::vector<float>& data, Deadline deadline);
+
+    // Sum and count of the measurements of an hour.
+    struct HourlyAvg {
+        double value = 0.0;
+        int total = 0;
+    };
+
+    void group_by_hour(std::pmr::vector<float>& data,
+                       const std::array<HourlyAvg, 24>& hourly_agg,
+                       int current_hour, bool same_date);
+
+    net::awaitable<void>
+    save_aggregated_data(CassUuid sensor_id,
+                         const std::chrono::year_month_day& date,
+                         const std::pmr::vector<float>& data,
+                         int prev_avg_size, bool same_date, int current_hour,
+                         Deadline deadline);
+
+    using Handler = net::awaitable<Response> (Impl::*)(
+        const Request& req, const ResponseFactory& responses,
+        Deadline deadline, const RouteParams& params);
+
+    struct Endpoint {
+        Route route;
+        Handler handler;
+    };
+
+    void add_route(http::verb method, std::string_view pattern, Route route,
+                   Handler handler) {
+        this->router.add(method, pattern);
+        this->endpoints.push_back(Endpoint{route, handler});
+    }
+
+    // `endpoints[i]` handles the route the router numbered `i`.
+    Router router;
+    std::vector<Endpoint> endpoints;
+
+    std::unique_ptr<Storage> storage;
+    const ServerStats& stats;
+    std::chrono::milliseconds stream_page_timeout;
+
+    // Response bodies of the averages of completed days, which never
+    // change. Null if the cache is off.
+    using AvgCache =
+        ShardedCache<SensorDay, std::shared_ptr<const std::string>,
+                     SensorDayHash>;
+    std::unique_ptr<AvgCache> avg_responses;
+
+    // Requests for the same day of a sensor arriving together share one
+    // `daily_averages`, so they scan and store the day once.
+    SingleFlight<SensorDay, DailyAverages, SensorDayHash> averaging;
+
+    // Daily averages: hours read back from storage and hours aggregated
+    // from raw measurements.
+    ShardedCounter avg_hours_served;
+    ShardedCounter avg_hours_computed;
+    ShardedCounter aggregations;
+    ShardedCounter coalesced_averages;
 };
 
-RequestHandler::RequestHandler(Database db)
-    : pImpl(std::make_unique<Impl>(std::move(db))) {}
+RequestHandler::Impl::Impl(std::unique_ptr<Storage> storage,
+                           const ServerStats& stats,
+                           const HandlerConfig& config)
+    : storage(std::move(storage)), stats(stats),
+      stream_page_timeout(config.stream_page_timeout) {
+    if (config.avg_cache_bytes > 0) {
+        // Entries stay valid forever; the TTL only lets averages dropped
+        // for recalculation be read again eventually.
+        this->avg_responses = std::make_unique<AvgCache>(
+            "sensor_avg", config.avg_cache_bytes,
+            2 * std::max(1u, std::thread::hardware_concurrency()),
+            std::chrono::hours(24), std::chrono::hours(24));
+    }
+    // clang-format off
+    this->add_route(http::verb::get, "/owner/{owner_id:uuid}", Route::owner, &Impl::handle_get_owner);
+    this->add_route(http::verb::get, "/owner/{owner_id:uuid}/pets", Route::pets, &Impl::handle_get_pets);
+    this->add_route(http::verb::get, "/pet/{pet_id:uuid}/sensors", Route::sensors, &Impl::handle_get_sensors);
+    this->add_route(http::verb::get, "/pet/{pet_id:uuid}/values", Route::pet_measurements, &Impl::handle_get_pet_measurements);
+    this->add_route(http::verb::get, "/sensors/{sensor_id:uuid}/values", Route::measurements, &Impl::handle_get_measurements);
+    this->add_route(http::verb::get, "/sensors/{sensor_id:uuid}/values/day/{date:date}", Route::sensor_avg, &Impl::handle_get_sensor_avg);
+    this->add_route(http::verb::get, "/stats/statements", Route::statement_stats, &Impl::handle_get_statement_stats);
+    this->add_route(http::verb::get, "/stats/server", Route::server_stats, &Impl::handle_get_server_stats);
+    this->add_route(http::verb::get, "/metrics", Route::metrics, &Impl::handle_get_metrics);
+    // clang-format on
+}
+
+RequestHandler::RequestHandler(std::unique_ptr<Storage> storage,
+                               const ServerStats& stats,
+                               const HandlerConfig& config)
+    : pImpl(std::make_unique<Impl>(std::move(storage), stats, config)) {}
 
 RequestHandler::~RequestHandler() = default;
 
-http::response<http::string_body>
-RequestHandler::handle_request(const http::request<http::string_body>& req) {
-    const ResponseFactory responseFactory(req);
+net::awaitable<Response>
+RequestHandler::handle_request(const Request& req, RequestArena& arena,
+                               Deadline deadline) {
+    const ResponseFactory responseFactory(req, arena);
+
+    // Emplaced rather than assigned: assigning a message moves its fields
+    // only between equal allocators.
+    Route route = Route::other;
+    std::optional<Response> response;
+    try {
+        response.emplace(co_await this->pImpl->dispatch(req, responseFactory,
+                                                        deadline, route));
+    } catch (const DeadlineExceeded& e) {
+        response.emplace(responseFactory.gatewayTimeout(e.what()));
+    }
+    response->route = route;
+    co_return std::move(*response);
+}
+
+net::awaitable<Response>
+RequestHandler::Impl::dispatch(const Request& req,
+                               const ResponseFactory& responseFactory,
+                               Deadline deadline, Route& route) {
+    beast::string_view target = req.target();
+    RouteParams params;
+    Router::Match match = this->router.match(
+        req.method(), {target.data(), target.size()}, params);
+
+    switch (match.result) {
+    case Router::Match::found: {
+        const Endpoint& endpoint = this->endpoints[match.route];
+        route = endpoint.route;
+        co_return co_await (this->*endpoint.handler)(req, responseFactory,
+                                                     deadline, params);
+    }
+    case Router::Match::method_not_allowed:
+        co_return responseFactory.methodNotAllowed(match.allow);
+    case Router::Match::bad_parameter:
+        co_return responseFactory.badRequest(
+            std::format("Invalid {}", match.parameter));
+    case Router::Match::not_found:
+        break;
+    }
+    co_return responseFactory.notFound(req.target());
+}
+
+net::awaitable<Response> RequestHandler::Impl::handle_get_statement_stats(
+    const Request& req, const ResponseFactory& responses, Deadline deadline,
+    const RouteParams& params) {
+    co_return responses.apiResponse(boost::json::value_from(
+        this->statement_stats(), responses.storage()));
+}
+
+net::awaitable<Response> RequestHandler::Impl::handle_get_server_stats(
+    const Request& req, const ResponseFactory& responses, Deadline deadline,
+    const RouteParams& params) {
+    co_return responses.apiResponse(this->server_stats(responses.storage()));
+}
 
-    if (req.method() != http::verb::get) {
-        return responseFactory.badRequest("Unknown HTTP-method");
+net::awaitable<Response> RequestHandler::Impl::handle_get_metrics(
+    const Request& req, const ResponseFactory& responses, Deadline deadline,
+    const RouteParams& params) {
+    co_return responses.metricsResponse(this->metrics());
+}
+
+std::string RequestHandler::Impl::metrics() const {
+    PrometheusWriter out;
+
+    out.family("carepet_http_responses_total", "counter",
+               "HTTP responses by route and status class.");
+    for (size_t r = 0; r < route_count; r++) {
+        const RouteMetrics& route = this->stats.route(Route(r));
+        for (size_t c = 0; c < route.responses.size(); c++) {
+            std::string code = std::format("{}xx", c + 1);
+            out.sample("carepet_http_responses_total",
+                       {{"route", route_names[r]}, {"code", code}},
+                       route.responses[c].load());
+        }
+    }
+    out.family("carepet_http_request_duration_seconds", "histogram",
+               "Time from reading a request to sending its response.");
+    for (size_t r = 0; r < route_count; r++) {
+        out.histogram("carepet_http_request_duration_seconds",
+                      {{"route", route_names[r]}},
+                      this->stats.route(Route(r)).latency, latency_buckets);
+    }
+    out.family("carepet_http_request_bytes_total", "counter",
+               "Bytes of HTTP requests received.");
+    for (size_t r = 0; r < route_count; r++) {
+        out.sample("carepet_http_request_bytes_total",
+                   {{"route", route_names[r]}},
+                   this->stats.route(Route(r)).bytes_in.load());
+    }
+    out.family("carepet_http_response_bytes_total", "counter",
+               "Bytes of HTTP responses sent, after compression.");
+    for (size_t r = 0; r < route_count; r++) {
+        out.sample("carepet_http_response_bytes_total",
+                   {{"route", route_names[r]}},
+                   this->stats.route(Route(r)).bytes_out.load());
     }
 
-    boost::url_view url(req.target());
-    boost::urls::segments_view path_segments_view = url.segments();
-    std::vector<std::string> path_segments(path_segments_view.begin(),
-                                           path_segments_view.end());
-    // Ugly request routing - for such small example it doesn't make sense
-    // to write something more sophisticated.
-
-    // /owner/{owner_id}
-    if (path_segments.size() == 2 && path_segments[0] == "owner") {
-        return this->pImpl->handle_get_owner(req, responseFactory,
-                                             path_segments[1]);
-    }
-    // /owner/{owner_id}/pets
-    if (path_segments.size() == 3 && path_segments[0] == "owner" &&
-        path_segments[2] == "pets") {
-        return this->pImpl->handle_get_pets(req, responseFactory,
-                                            path_segments[1]);
-    }
-    // /pet/{pet_id}/sensors
-    if (path_segments.size() == 3 && path_segments[0] == "pet" &&
-        path_segments[2] == "sensors") {
-        return this->pImpl->handle_get_sensors(req, responseFactory,
-                                               path_segments[1]);
-    }
-    // /sensors/{sensor_id}/values
-    if (path_segments.size() == 3 && path_segments[0] == "sensors" &&
-        path_segments[2] == "values") {
-        auto params = url.params();
-        auto from_iter = params.find("from"), to_iter = params.find("to");
-        if (from_iter == params.end()) {
-            return responseFactory.badRequest("No value for \"to\" parameter");
-        }
-        if (to_iter == params.end()) {
-            return responseFactory.badRequest(
-                "No value for \"from\" parameter");
-        }
-        std::string from((*from_iter).value), to((*to_iter).value);
-        return this->pImpl->handle_get_measurements(req, responseFactory,
-                                                    path_segments[1], from, to);
-    }
-    // /sensors/{sensor_id}/values/day/{date}
-    if (path_segments.size() == 5 && path_segments[0] == "sensors" &&
-        path_segments[2] == "values" && path_segments[3] == "day") {
-        return this->pImpl->handle_get_sensor_avg(
-            req, responseFactory, path_segments[1], path_segments[4]);
-    }
-
-    return responseFactory.notFound(req.target());
+    struct ShardMetric {
+        std::string_view name;
+        std::string_view type;
+        std::string_view help;
+        int64_t (*value)(const ShardStats&);
+    };
+    // clang-format off
+    static constexpr ShardMetric shard_metrics[] = {
+        {"carepet_http_open_connections", "gauge", "Open HTTP connections.",
+         [](const ShardStats& s) -> int64_t { return s.open_connections.load(); }},
+        {"carepet_http_in_flight_requests", "gauge", "HTTP requests being handled.",
+         [](const ShardStats& s) -> int64_t { return s.in_flight_requests.load(); }},
+        {"carepet_http_connections_accepted_total", "counter", "Accepted HTTP connections.",
+         [](const ShardStats& s) -> int64_t { return s.accepted.load(); }},
+        {"carepet_http_connections_rejected_total", "counter", "Connections refused by --max-connections.",
+         [](const ShardStats& s) -> int64_t { return s.rejected_connections.load(); }},
+        {"carepet_http_connections_timed_out_total", "counter", "Connections closed by a timeout.",
+         [](const ShardStats& s) -> int64_t { return s.timed_out_connections.load(); }},
+        {"carepet_http_requests_queued_total", "counter", "Requests that waited for admission.",
+         [](const ShardStats& s) -> int64_t { return s.queued_requests.load(); }},
+        {"carepet_http_requests_shed_total", "counter", "Requests shed with 503.",
+         [](const ShardStats& s) -> int64_t { return s.shed_requests.load(); }},
+        {"carepet_http_arena_heap_blocks_total", "counter", "Heap blocks taken by request arenas that outgrew their buffer.",
+         [](const ShardStats& s) -> int64_t { return s.arena_heap_blocks.load(); }},
+    };
+    // clang-format on
+    for (const ShardMetric& metric : shard_metrics) {
+        out.family(metric.name, metric.type, metric.help);
+        for (size_t i = 0; i < this->stats.shard_count(); i++) {
+            std::string shard = std::to_string(i);
+            out.sample(metric.name, {{"shard", shard}},
+                       metric.value(this->stats.shard(i)));
+        }
+    }
+
+    std::vector<StatementStats> statements = this->statement_stats();
+    struct StatementMetric {
+        std::string_view name;
+        std::string_view help;
+        uint64_t StatementStats::*value;
+    };
+    // clang-format off
+    static constexpr StatementMetric statement_metrics[] = {
+        {"carepet_db_errors_total", "Failed statement executions.", &StatementStats::errors},
+        {"carepet_db_rows_total", "Rows returned.", &StatementStats::rows},
+        {"carepet_db_bytes_total", "Bytes of bound parameters sent.", &StatementStats::bytes},
+        {"carepet_db_retries_total", "Statement retries.", &StatementStats::retries},
+        {"carepet_db_hedges_total", "Hedged executions sent.", &StatementStats::hedges},
+        {"carepet_db_hedge_wins_total", "Hedges that answered first.", &StatementStats::hedge_wins},
+        {"carepet_db_deadlines_exceeded_total", "Statements that ran out of time.", &StatementStats::deadlines_exceeded},
+    };
+    // clang-format on
+    out.family("carepet_db_statement_duration_seconds", "summary",
+               "Latency of statement executions; every page of a streamed "
+               "range is one execution.");
+    for (const StatementStats& statement : statements) {
+        out.summary("carepet_db_statement_duration_seconds",
+                    {{"query", statement.query}}, statement.latency);
+    }
+    for (const StatementMetric& metric : statement_metrics) {
+        out.family(metric.name, "counter", metric.help);
+        for (const StatementStats& statement : statements) {
+            out.sample(metric.name, {{"query", statement.query}},
+                       statement.*metric.value);
+        }
+    }
+
+    std::vector<CacheStats> caches = this->storage->cache_stats();
+    if (this->avg_responses) {
+        caches.push_back(this->avg_responses->stats());
+    }
+    out.family("carepet_cache_requests_total", "counter",
+               "Cache lookups by result; a negative hit found a remembered "
+               "absence.");
+    for (const CacheStats& cache : caches) {
+        out.sample("carepet_cache_requests_total",
+                   {{"cache", cache.name}, {"result", "hit"}}, cache.hits);
+        out.sample("carepet_cache_requests_total",
+                   {{"cache", cache.name}, {"result", "negative_hit"}},
+                   cache.negative_hits);
+        out.sample("carepet_cache_requests_total",
+                   {{"cache", cache.name}, {"result", "miss"}}, cache.misses);
+    }
+    struct CacheMetric {
+        std::string_view name;
+        std::string_view type;
+        std::string_view help;
+        uint64_t CacheStats::*value;
+    };
+    // clang-format off
+    static constexpr CacheMetric cache_metrics[] = {
+        {"carepet_cache_evictions_total", "counter", "Entries evicted to make room.", &CacheStats::evictions},
+        {"carepet_cache_invalidations_total", "counter", "Keys invalidated by writes.", &CacheStats::invalidations},
+        {"carepet_cache_entries", "gauge", "Entries held.", &CacheStats::entries},
+        {"carepet_cache_bytes", "gauge", "Estimated memory held by the entries.", &CacheStats::bytes},
+    };
+    // clang-format on
+    for (const CacheMetric& metric : cache_metrics) {
+        out.family(metric.name, metric.type, metric.help);
+        for (const CacheStats& cache : caches) {
+            out.sample(metric.name, {{"cache", cache.name}},
+                       cache.*metric.value);
+        }
+    }
+
+    out.family("carepet_sensor_avg_hours_total", "counter",
+               "Hourly averages served, by where they came from.");
+    out.sample("carepet_sensor_avg_hours_total", {{"source", "storage"}},
+               this->avg_hours_served.load());
+    out.sample("carepet_sensor_avg_hours_total", {{"source", "computed"}},
+               this->avg_hours_computed.load());
+    out.family("carepet_sensor_avg_aggregations_total", "counter",
+               "Daily average requests that aggregated raw measurements.");
+    out.sample("carepet_sensor_avg_aggregations_total", {},
+               this->aggregations.load());
+    out.family("carepet_sensor_avg_coalesced_total", "counter",
+               "Daily average requests that waited for an identical one "
+               "in flight instead of querying.");
+    out.sample("carepet_sensor_avg_coalesced_total", {},
+               this->coalesced_averages.load());
+
+    if (std::optional<uint64_t> allocations = heap_allocations()) {
+        out.family("carepet_heap_allocations_total", "counter",
+                   "Calls to the global operator new.");
+        out.sample("carepet_heap_allocations_total", {}, *allocations);
+    }
+
+    return std::move(out.str());
 }
 
 #define ASSERT_SUCCESS(ERR_EXPR, MESSAGE)                                      \
@@ -225,18 +910,14 @@ RequestHandler::handle_request(const http::request<http::string_body>& req) {
 
 class ParsingError {};
 
-std::optional<std::chrono::year_month_day>
-parse_date(const std::string& date_str) {
-    // Parse date using C++20 chrono
-    std::istringstream in{date_str};
-    std::chrono::year_month_day ymd;
-    in >> std::chrono::parse("%F", ymd);
-    if (in.fail() || !ymd.ok()) {
-        return std::nullopt;
-    }
-
-    return ymd;
-}
+// Averages in storage that do not start at hour 0 or skip hours.
+class InvalidAverages : public std::runtime_error {
+  public:
+    InvalidAverages()
+        : std::runtime_error(
+              "Invalid cached averages data. Please drop avg data for this "
+              "date in order to recalculate") {}
+};
 
 std::pair<cass_int64_t, cass_int64_t>
 get_day_time_range(const std::chrono::year_month_day& date) {
@@ -264,262 +945,506 @@ int get_hour_from_time_point(
     return time_of_day.hours().count();
 }
 
-std::optional<cass_int64_t> parse_iso_datetime(const std::string& iso_date) {
-    std::istringstream in{iso_date};
-    std::chrono::sys_time<std::chrono::milliseconds> tp;
-    in >> std::chrono::parse("%FT%TZ", tp);
-    if (in.fail()) {
-        in.clear();
-        in.exceptions(std::ios::failbit);
-        in.str(iso_date);
-        in >> std::chrono::parse("%FT%T%Ez", tp);
+// Reads the `width` digits at the start of `s` into `value` and drops
+// them.
+static bool take_digits(std::string_view& s, size_t width, int& value) {
+    if (s.size() < width) {
+        return false;
     }
-    if (in.fail()) {
-        return std::nullopt;
+    value = 0;
+    for (char c : s.substr(0, width)) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + (c - '0');
     }
-    return tp.time_since_epoch().count();
+    s.remove_prefix(width);
+    return true;
 }
 
-std::optional<CassUuid> parse_uuid(const char* uuid_str) {
-    CassUuid result;
-    if (cass_uuid_from_string(uuid_str, &result) != CASS_OK) {
-        return std::nullopt;
-    };
-    return result;
+// Drops `c` from the start of `s`, if it is there.
+static bool take(std::string_view& s, char c) {
+    if (s.empty() || s.front() != c) {
+        return false;
+    }
+    s.remove_prefix(1);
+    return true;
 }
 
-http::response<http::string_body> RequestHandler::Impl::handle_get_owner(
-    const http::request<http::string_body>& req,
-    const ResponseFactory& responses, std::string owner_id_str) {
-    auto maybe_owner_id = parse_uuid(owner_id_str.c_str());
-    if (!maybe_owner_id) {
-        return responses.badRequest("Invalid owner id");
+// Parses `YYYY-MM-DDTHH:MM:SS`, with optional fractions of a second, in
+// UTC (`Z`) or at an offset (`+HH:MM`, `-HH:MM`), into milliseconds since
+// the epoch.
+std::optional<cass_int64_t> parse_iso_datetime(std::string_view iso_date) {
+    using namespace std::chrono;
+
+    std::string_view s = iso_date;
+    int y, mo, d, h, mi, sec;
+    if (!take_digits(s, 4, y) || !take(s, '-') || !take_digits(s, 2, mo) ||
+        !take(s, '-') || !take_digits(s, 2, d) || !take(s, 'T') ||
+        !take_digits(s, 2, h) || !take(s, ':') || !take_digits(s, 2, mi) ||
+        !take(s, ':') || !take_digits(s, 2, sec)) {
+        return std::nullopt;
+    }
+    year_month_day date{year(y), month(mo), day(d)};
+    if (!date.ok() || h > 23 || mi > 59 || sec > 60) {
+        return std::nullopt;
     }
-    CassUuid owner_id = *maybe_owner_id;
 
-    QueryResult result = db.execute(fetch_owner, owner_id);
-    Rows rows = result.rows<CassUuid, std::string, std::string>();
+    // Digits past milliseconds are dropped.
+    int64_t ms = 0;
+    if (take(s, '.')) {
+        size_t digits = 0;
+        for (; digits < s.size() && s[digits] >= '0' && s[digits] <= '9';
+             digits++) {
+            if (digits < 3) {
+                ms = ms * 10 + (s[digits] - '0');
+            }
+        }
+        if (digits == 0) {
+            return std::nullopt;
+        }
+        for (size_t i = digits; i < 3; i++) {
+            ms *= 10;
+        }
+        s.remove_prefix(digits);
+    }
 
-    auto row = rows.next_row();
-    if (!row) {
-        return responses.badRequest("No owner with this id found");
+    minutes offset{0};
+    if (!take(s, 'Z')) {
+        bool negative = take(s, '-');
+        if (!negative && !take(s, '+')) {
+            return std::nullopt;
+        }
+        int oh, om;
+        if (!take_digits(s, 2, oh) || !take(s, ':') ||
+            !take_digits(s, 2, om) || om > 59) {
+            return std::nullopt;
+        }
+        offset = hours(oh) + minutes(om);
+        if (negative) {
+            offset = -offset;
+        }
+    }
+    if (!s.empty()) {
+        return std::nullopt;
     }
-    auto [selected_owner_id, name, address] = *row;
-    // We know there will be at most one row.
 
-    Owner owner{.id = selected_owner_id, .name = name, .address = address};
+    sys_time<milliseconds> tp = sys_days(date) + hours(h) + minutes(mi) +
+                                seconds(sec) + milliseconds(ms) - offset;
+    return tp.time_since_epoch().count();
+}
 
-    return responses.apiResponse(boost::json::value_from(owner));
+// Decodes the query parameter `name` of `url` into `buffer`, without
+// allocating. Empty if the parameter is missing; an empty view if it does
+// not fit, which no parameter is valid as.
+template <size_t N>
+static std::optional<std::string_view>
+query_param(boost::urls::url_view url, std::string_view name,
+            std::array<char, N>& buffer) {
+    auto query = url.encoded_params();
+    auto it = query.find(boost::urls::pct_string_view(name));
+    if (it == query.end()) {
+        return std::nullopt;
+    }
+    // Like `params()`, which reads '+' as a space.
+    boost::urls::decode_view value((*it).value,
+                                   boost::urls::encoding_opts(true));
+    if (value.size() > buffer.size()) {
+        return std::string_view();
+    }
+    std::copy(value.begin(), value.end(), buffer.begin());
+    return std::string_view(buffer.data(), value.size());
 }
 
-http::response<http::string_body> RequestHandler::Impl::handle_get_pets(
-    const http::request<http::string_body>& req,
-    const ResponseFactory& responses, std::string owner_id_str) {
-    auto maybe_owner_id = parse_uuid(owner_id_str.c_str());
-    if (!maybe_owner_id) {
-        return responses.badRequest("Invalid owner id");
+// Reads the `from` and `to` query parameters of `req`. Returns what is
+// wrong with them, or null.
+static const char* parse_time_range(const Request& req, int64_t& from,
+                                    int64_t& to) {
+    boost::url_view url(req.target());
+    std::array<char, 64> from_buffer, to_buffer;
+    std::optional<std::string_view> from_str =
+        query_param(url, "from", from_buffer);
+    std::optional<std::string_view> to_str = query_param(url, "to", to_buffer);
+    if (!from_str) {
+        return "No value for \"from\" parameter";
+    }
+    if (!to_str) {
+        return "No value for \"to\" parameter";
     }
-    CassUuid owner_id = *maybe_owner_id;
-    QueryResult query_result = db.execute(fetch_pets, owner_id);
-    std::vector<Pet> pets;
-    Rows rows = query_result.rows<CassUuid, CassUuid, std::string, std::string,
-                                  std::string, std::string, std::string,
-                                  int32_t, float, std::string, std::string>();
-    for (auto row = rows.next_row(); row; row = rows.next_row()) {
-        auto [pet_id, owner_id, chip_id, species, breed, color, gender, age,
-              weight, address, name] = *row;
-        Pet pet{.id = pet_id,
-                .owner_id = owner_id,
-                .chip_id = chip_id,
-                .species = species,
-                .breed = breed,
-                .color = color,
-                .gender = gender,
-                .age = age,
-                .weight = weight,
-                .address = address,
-                .name = name};
-        pets.push_back(pet);
+
+    auto maybe_from = parse_iso_datetime(*from_str);
+    if (!maybe_from) {
+        return "Invalid `from` date";
     }
+    from = *maybe_from;
 
-    return responses.apiResponse(boost::json::value_from(pets));
+    auto maybe_to = parse_iso_datetime(*to_str);
+    if (!maybe_to) {
+        return "Invalid `to` date";
+    }
+    to = *maybe_to;
+    return nullptr;
 }
 
-http::response<http::string_body> RequestHandler::Impl::handle_get_sensors(
-    const http::request<http::string_body>& req,
-    const ResponseFactory& responses, std::string pet_id_str) {
-    auto maybe_pet_id = parse_uuid(pet_id_str.c_str());
-    if (!maybe_pet_id) {
-        return responses.badRequest("Invalid pet id");
+// How to downsample a range.
+struct DownsamplingParams {
+    Downsampling method;
+    // Width of a bucket, in milliseconds.
+    cass_int64_t width;
+};
+
+// Reads the `points` or `step` and `method` query parameters of `req`, a
+// request for [from, to]. `params` stays empty without `points` and
+// `step`. Returns what is wrong with them, or null.
+static const char*
+parse_downsampling_params(const Request& req, int64_t from, int64_t to,
+                          std::optional<DownsamplingParams>& params) {
+    boost::url_view url(req.target());
+    std::array<char, 32> points_buffer, step_buffer, method_buffer;
+    std::optional<std::string_view> points_str =
+        query_param(url, "points", points_buffer);
+    std::optional<std::string_view> step_str =
+        query_param(url, "step", step_buffer);
+    std::optional<std::string_view> name =
+        query_param(url, "method", method_buffer);
+    if (!points_str && !step_str) {
+        if (name) {
+            return "`method` needs `points` or `step`";
+        }
+        return nullptr;
+    }
+    if (points_str && step_str) {
+        return "Only one of `points` and `step` may be given";
     }
-    CassUuid pet_id = *maybe_pet_id;
 
-    QueryResult result = db.execute(fetch_sensors, pet_id);
-    Rows rows = result.rows<CassUuid, CassUuid, std::string>();
+    Downsampling method = Downsampling::avg;
+    if (name) {
+        std::optional<Downsampling> maybe_method = parse_downsampling(*name);
+        if (!maybe_method) {
+            return "Invalid `method`, expected avg, min, max or lttb";
+        }
+        method = *maybe_method;
+    }
+
+    // A single bucket covers the whole range, so no width needs to be
+    // wider. Keeps bucket arithmetic within int64.
+    int64_t span = std::max<int64_t>(to - from + 1, 1);
+    cass_int64_t width;
+    if (points_str) {
+        int64_t points = 0;
+        const char* last = points_str->data() + points_str->size();
+        auto [end, ec] = std::from_chars(points_str->data(), last, points);
+        if (ec != std::errc() || end != last || points <= 0) {
+            return "Invalid `points`";
+        }
+        // Rounded up, so that there are at most `points` buckets.
+        width = span / points + (span % points != 0);
+    } else {
+        std::optional<cass_int64_t> step = parse_step(*step_str);
+        if (!step) {
+            return "Invalid `step`";
+        }
+        width = std::min(*step, span);
+    }
+    params = DownsamplingParams{.method = method, .width = width};
+    return nullptr;
+}
+
+net::awaitable<Response> RequestHandler::Impl::handle_get_owner(
+    const Request& req, const ResponseFactory& responses, Deadline deadline,
+    const RouteParams& params) {
+    CassUuid owner_id = params.uuid(0);
 
-    std::vector<Sensor> sensors;
-    for (auto row = rows.next_row(); row; row = rows.next_row()) {
-        auto [sensor_id, pet_id, type] = *row;
-        Sensor sensor{
-            .id = sensor_id,
-            .pet_id = pet_id,
-            .type = type,
-        };
-        sensors.push_back(sensor);
+    RecordSet<OwnerView> owners =
+        co_await storage->get_owner(owner_id, deadline);
+    if (owners.records.empty()) {
+        co_return responses.badRequest("No owner with this id found");
     }
+    // We know there will be at most one row.
+    const OwnerView& owner = owners.records.front();
 
-    return responses.apiResponse(boost::json::value_from(sensors));
+    co_return responses.apiResponse(
+        boost::json::value_from(owner, responses.storage()));
 }
 
-http::response<http::string_body> RequestHandler::Impl::handle_get_measurements(
-    const http::request<http::string_body>& req,
-    const ResponseFactory& responses, std::string sensor_id_str,
-    std::string from_str, std::string to_str) {
+net::awaitable<Response> RequestHandler::Impl::handle_get_pets(
+    const Request& req, const ResponseFactory& responses, Deadline deadline,
+    const RouteParams& params) {
+    CassUuid owner_id = params.uuid(0);
+    RecordSet<PetView> pets = co_await storage->get_pets(owner_id, deadline);
+
+    co_return responses.apiResponse(
+        boost::json::value_from(pets.records, responses.storage()));
+}
+
+net::awaitable<Response> RequestHandler::Impl::handle_get_sensors(
+    const Request& req, const ResponseFactory& responses, Deadline deadline,
+    const RouteParams& params) {
+    CassUuid pet_id = params.uuid(0);
+
+    RecordSet<SensorView> sensors =
+        co_await storage->get_sensors(pet_id, deadline);
 
-    auto maybe_sensor_id = parse_uuid(sensor_id_str.c_str());
-    if (!maybe_sensor_id) {
-        return responses.badRequest("Invalid sensor id");
+    co_return responses.apiResponse(
+        boost::json::value_from(sensors.records, responses.storage()));
+}
+
+net::awaitable<Response> RequestHandler::Impl::handle_get_measurements(
+    const Request& req, const ResponseFactory& responses, Deadline deadline,
+    const RouteParams& params) {
+    CassUuid sensor_id = params.uuid(0);
+
+    int64_t from, to;
+    if (const char* error = parse_time_range(req, from, to)) {
+        co_return responses.badRequest(error);
+    }
+    std::optional<DownsamplingParams> downsampling;
+    if (const char* error =
+            parse_downsampling_params(req, from, to, downsampling)) {
+        co_return responses.badRequest(error);
     }
-    CassUuid sensor_id = *maybe_sensor_id;
 
-    auto maybe_from = parse_iso_datetime(from_str);
-    if (!maybe_from) {
-        return responses.badRequest("Invalid `from` date");
+    beast::string_view accept = req[http::field::accept];
+    SampleFormat format =
+        negotiate_sample_format({accept.data(), accept.size()});
+
+    // Sensors only write current measurements, so a range that ended
+    // before today (UTC) never changes.
+    std::chrono::sys_time<std::chrono::milliseconds> today =
+        std::chrono::floor<std::chrono::days>(std::chrono::system_clock::now());
+    std::pmr::string etag(responses.resource());
+    if (to < today.time_since_epoch().count()) {
+        // Each format is a representation of its own. JSON keeps the tags
+        // it had before there were others.
+        std::pmr::string key(responses.resource());
+        std::format_to(std::back_inserter(key), "{}.{}", from, to);
+        if (downsampling) {
+            std::format_to(std::back_inserter(key), ".{}.{}",
+                           downsampling_name(downsampling->method),
+                           downsampling->width);
+        }
+        if (format != SampleFormat::json) {
+            std::format_to(std::back_inserter(key), ".{}",
+                           sample_format_name(format));
+        }
+        etag = immutable_etag("range", sensor_id, key, responses.resource());
+        if (if_none_match(req[http::field::if_none_match], etag)) {
+            ResponseMessage res = responses.notModified(etag);
+            res.set(http::field::vary, "Accept");
+            co_return res;
+        }
     }
-    int64_t from = *maybe_from;
 
-    auto maybe_to = parse_iso_datetime(to_str);
-    if (!maybe_to) {
-        return responses.badRequest("Invalid `to` date");
+    // Only the first page is read before the header, so only it is held to
+    // the request deadline.
+    std::unique_ptr<MeasurementStream> stream = storage->get_measurements(
+        sensor_id, from, to, StreamDeadline(deadline, stream_page_timeout));
+    if (downsampling) {
+        stream = downsample(std::move(stream), downsampling->method, from,
+                            downsampling->width);
+    }
+
+    // Errors on the first page can still become a proper error response.
+    bool has_page = co_await stream->next_page();
+    Response response = responses.apiStream(arena_new<MeasurementBody>(
+        responses.resource(), std::move(stream), has_page,
+        sample_encoder(format, sensor_id, responses.resource())));
+    std::string_view content_type = sample_content_type(format);
+    response.message.set(
+        http::field::content_type,
+        beast::string_view(content_type.data(), content_type.size()));
+    response.message.set(http::field::vary, "Accept");
+    if (!etag.empty()) {
+        set_immutable(response.message, etag);
+    }
+    co_return response;
+}
+
+net::awaitable<Response> RequestHandler::Impl::handle_get_pet_measurements(
+    const Request& req, const ResponseFactory& responses, Deadline deadline,
+    const RouteParams& params) {
+    CassUuid pet_id = params.uuid(0);
+
+    int64_t from, to;
+    if (const char* error = parse_time_range(req, from, to)) {
+        co_return responses.badRequest(error);
     }
-    int64_t to = *maybe_to;
 
-    QueryResult query_result =
-        db.execute(fetch_measurements, sensor_id, from, to);
-    Rows rows = query_result.rows<int64_t, float>();
+    RecordSet<SensorView> sensors =
+        co_await storage->get_sensors(pet_id, deadline);
 
-    std::vector<Measure> measurements;
-    for (auto row = rows.next_row(); row; row = rows.next_row()) {
-        auto [ts, value] = *row;
-        Measure m{.sensor_id = sensor_id, .ts = ts, .value = value};
-        measurements.push_back(m);
+    std::pmr::vector<std::unique_ptr<MeasurementStream>> streams(
+        responses.resource());
+    streams.reserve(sensors.records.size());
+    StreamDeadline stream_deadline(deadline, stream_page_timeout);
+    for (const SensorView& sensor : sensors.records) {
+        streams.push_back(
+            storage->get_measurements(sensor.id, from, to, stream_deadline));
     }
 
-    return responses.apiResponse(boost::json::value_from(measurements));
+    // Errors on the first pages can still become a proper error response.
+    std::pmr::vector<bool> has_page =
+        co_await first_pages(streams, responses.resource());
+    co_return responses.apiStream(arena_new<PetMeasurementBody>(
+        responses.resource(), std::move(sensors), std::span(streams),
+        has_page, responses.resource()));
 }
 
-http::response<http::string_body> RequestHandler::Impl::handle_get_sensor_avg(
-    const http::request<http::string_body>& req,
-    const ResponseFactory& responses, std::string sensor_id_str,
-    std::string date_str) {
-    auto maybe_sensor_id = parse_uuid(sensor_id_str.c_str());
-    if (!maybe_sensor_id) {
-        return responses.badRequest("Invalid sensor id");
-    }
-    CassUuid sensor_id = *maybe_sensor_id;
+net::awaitable<Response> RequestHandler::Impl::handle_get_sensor_avg(
+    const Request& req, const ResponseFactory& responses, Deadline deadline,
+    const RouteParams& params) {
+    CassUuid sensor_id = params.uuid(0);
+    std::chrono::year_month_day requested_date = params.date(1);
+    std::string_view date_str = params.str(1);
 
     auto now = std::chrono::system_clock::now();
 
-    auto maybe_date = parse_date(date_str);
-    if (!maybe_date) {
-        return responses.badRequest("Invalid date or request into the future");
+    // Check if date is in the future
+    auto today_days = std::chrono::floor<std::chrono::days>(now);
+    auto requested_date_days = std::chrono::sys_days{requested_date};
+    if (requested_date_days > today_days) {
+        co_return responses.badRequest(
+            "Can't get avearges for date in the future");
     }
-    std::chrono::year_month_day requested_date = *maybe_date;
-
-    {
-        // Check if date is in the future
-        auto today_days = std::chrono::floor<std::chrono::days>(now);
-        auto requested_date_days = std::chrono::sys_days{requested_date};
 
-        if (requested_date_days > today_days) {
-            return responses.badRequest(
-                "Can't get avearges for date in the future");
+    // The averages of a past day never change once stored, so a client
+    // that has them is answered without a query.
+    std::pmr::string etag(responses.resource());
+    bool complete = requested_date_days < today_days;
+    SensorDay day{.sensor_id = sensor_id, .date = requested_date_days};
+    AvgCache::Generation generation;
+    if (complete) {
+        etag = immutable_etag("avg", sensor_id, date_str, responses.resource());
+        if (if_none_match(req[http::field::if_none_match], etag)) {
+            co_return responses.notModified(etag);
+        }
+        if (this->avg_responses) {
+            if (std::optional<std::shared_ptr<const std::string>> body =
+                    this->avg_responses->get(day, generation)) {
+                ResponseMessage res = responses.apiResponse(**body);
+                set_immutable(res, etag);
+                co_return res;
+            }
         }
     }
 
-    QueryResult query_result = db.execute(fetch_avg, sensor_id, requested_date);
-    Rows rows = query_result.rows<int32_t, float>();
+    DailyAverages data;
+    bool joined = false;
+    try {
+        data = co_await this->averaging.run(
+            day, deadline,
+            [&] {
+                return this->daily_averages(sensor_id, now, requested_date,
+                                            responses.resource(), deadline);
+            },
+            joined);
+    } catch (const InvalidAverages& e) {
+        co_return responses.serverError(e.what());
+    }
+    if (joined) {
+        this->coalesced_averages.add(1);
+    }
 
-    std::vector<float> data;
-    for (auto row = rows.next_row(); row; row = rows.next_row()) {
-        auto [hour, avg] = *row;
+    // Convert to SensorAvg for response
+    std::pmr::vector<SensorAvg> sensor_avgs(responses.resource());
+    sensor_avgs.reserve(data.count);
+    for (size_t hour = 0; hour < data.count; ++hour) {
+        SensorAvg sensor_avg{.sensor_id = sensor_id,
+                             .date = std::string(date_str),
+                             .value = data.hours[hour]};
+        sensor_avgs.push_back(sensor_avg);
+    }
+
+    ResponseMessage res = responses.apiResponse(
+        boost::json::value_from(sensor_avgs, responses.storage()));
+    if (complete) {
+        set_immutable(res, etag);
+        // Today's averages are never stored: they are still growing.
+        if (this->avg_responses && data.count == 24) {
+            auto body = std::make_shared<const std::string>(
+                res.body().data(), res.body().size());
+            size_t bytes = sizeof(std::string) + body->capacity();
+            this->avg_responses->put(day, std::move(body), bytes, false,
+                                     generation);
+        }
+    }
+    co_return res;
+}
+
+net::awaitable<DailyAverages> RequestHandler::Impl::daily_averages(
+    CassUuid sensor_id,
+    const std::chrono::time_point<std::chrono::system_clock>& now,
+    const std::chrono::year_month_day& date,
+    std::pmr::memory_resource* scratch, Deadline deadline) {
+    std::vector<std::pair<int32_t, float>> averages =
+        co_await storage->get_sensor_avg(sensor_id, date, deadline);
+
+    std::pmr::vector<float> data(scratch);
+    data.reserve(24);
+    for (auto [hour, avg] : averages) {
         if (hour != data.size()) {
-            return responses.serverError(
-                "Invalid cached averages data. Please drop avg data for this "
-                "date in order to recalculate");
+            throw InvalidAverages();
         }
         data.push_back(avg);
     }
 
+    this->avg_hours_served.add(data.size());
     if (data.size() != 24) {
-        aggregate_missing_hours(sensor_id, now, requested_date, data);
-    }
-
-    // Convert to SensorAvg for response
-    std::vector<SensorAvg> sensor_avgs;
-    for (size_t hour = 0; hour < data.size(); ++hour) {
-        SensorAvg sensor_avg{
-            .sensor_id = sensor_id, .date = date_str, .value = data[hour]};
-        sensor_avgs.push_back(sensor_avg);
+        size_t served = data.size();
+        co_await aggregate_missing_hours(sensor_id, now, date, data,
+                                         deadline);
+        this->aggregations.add(1);
+        this->avg_hours_computed.add(data.size() - served);
     }
-
-    return responses.apiResponse(boost::json::value_from(sensor_avgs));
+    DailyAverages result;
+    result.count = data.size();
+    std::copy(data.begin(), data.end(), result.hours.begin());
+    co_return result;
 }
 
-void RequestHandler::Impl::aggregate_missing_hours(
+net::awaitable<void> RequestHandler::Impl::aggregate_missing_hours(
     CassUuid sensor_id,
     const std::chrono::time_point<std::chrono::system_clock>& now,
-    const std::chrono::year_month_day& date, std::vector<float>& data) {
+    const std::chrono::year_month_day& date, std::pmr::vector<float>& data,
+    Deadline deadline) {
 
     std::chrono::year_month_day now_date =
         std::chrono::year_month_day{std::chrono::floor<std::chrono::days>(now)};
     auto [start_ts, end_ts] = get_day_time_range(date);
 
-    QueryResult query_result =
-        db.execute(fetch_measurements, sensor_id, start_ts, end_ts);
-    Rows rows = query_result.rows<int64_t, float>();
-
-    std::vector<Measure> measures;
-    for (auto row = rows.next_row(); row; row = rows.next_row()) {
-        auto [ts, value] = *row;
-        Measure m{.sensor_id = sensor_id, .ts = ts, .value = value};
-        measures.push_back(m);
+    std::unique_ptr<MeasurementStream> stream =
+        storage->get_measurements(sensor_id, start_ts, end_ts, deadline);
+
+    // Pages are added into the sums of their hours as they arrive, so
+    // memory does not grow with the measurements of the day.
+    std::array<HourlyAvg, 24> hourly_agg{};
+    while (co_await stream->next_page()) {
+        for (const Sample& sample : stream->page()) {
+            HourlyAvg& a = hourly_agg[get_hour_from_timestamp(sample.ts)];
+            a.total++;
+            a.value += sample.value;
+        }
     }
 
     int prev_avg_size = data.size();
     int current_hour = get_hour_from_time_point(now);
     bool same_day = now_date == date;
-    group_by_hour(data, measures, current_hour, same_day);
+    group_by_hour(data, hourly_agg, current_hour, same_day);
 
-    save_aggregated_data(sensor_id, date, data, prev_avg_size, same_day,
-                         current_hour);
+    co_await save_aggregated_data(sensor_id, date, data, prev_avg_size,
+                                  same_day, current_hour, deadline);
 }
 
-void RequestHandler::Impl::group_by_hour(std::vector<float>& data,
-                                         const std::vector<Measure>& measures,
-                                         int current_hour, bool same_date) {
+void RequestHandler::Impl::group_by_hour(
+    std::pmr::vector<float>& data,
+    const std::array<HourlyAvg, 24>& hourly_agg, int current_hour,
+    bool same_date) {
     int start_hour = data.size();
 
-    struct HourlyAvg {
-        double value = 0.0;
-        int total = 0;
-    };
-
-    // aggregate data by hour
-    HourlyAvg hourly_agg[24];
-
-    for (const auto& m : measures) {
-        int hour = get_hour_from_timestamp(m.ts);
-
-        HourlyAvg& a = hourly_agg[hour];
-        a.total++;
-        a.value += m.value;
-    }
-
     // fill the averages
     for (int hour = start_hour;
          hour < 24 && (!same_date || hour <= current_hour); hour++) {
-        HourlyAvg& a = hourly_agg[hour];
+        const HourlyAvg& a = hourly_agg[hour];
         if (a.total > 0) {
             data.push_back(a.value / a.total);
         } else {
@@ -528,21 +1453,16 @@ void RequestHandler::Impl::group_by_hour(std::vector<float>& data,
     }
 }
 
-void RequestHandler::Impl::save_aggregated_data(
+net::awaitable<void> RequestHandler::Impl::save_aggregated_data(
     CassUuid sensor_id, const std::chrono::year_month_day& date,
-    const std::vector<float>& data, int prev_avg_size, bool same_date,
-    int current_hour) {
+    const std::pmr::vector<float>& data, int prev_avg_size, bool same_date,
+    int current_hour, Deadline deadline) {
     for (int hour = prev_avg_size; hour < (int)data.size(); hour++) {
         if (same_date && hour >= current_hour) {
             break;
         }
 
-        // Execute insert statement
-        char sensor_id_str[CASS_UUID_STRING_LENGTH];
-        cass_uuid_string(sensor_id, sensor_id_str);
-        std::cout << std::format("Inserting average. Sensor: {}, date: {}, "
-                                 "hour: {}, value: {}\n",
-                                 sensor_id_str, date, hour, (float)data[hour]);
-        db.execute(insert_sensor_avg, sensor_id, date, hour, (float)data[hour]);
+        co_await storage->insert_sensor_avg(sensor_id, date, hour,
+                                            (float)data[hour], deadline);
     }
 }
@@ -1,18 +1,74 @@
 #pragma once
 
-#include "database.hpp"
+#include "arena.hpp"
+#include "server_stats.hpp"
+#include "storage.hpp"
+#include <boost/asio/awaitable.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
 
 namespace http = boost::beast::http;
 
+// Body produced piece by piece while the response is being sent, so that
+// results of any size take bounded memory.
+class BodyStream {
+  public:
+    virtual ~BodyStream() = default;
+
+    // Appends the next piece of the body to `out`, a buffer that the
+    // connection reuses between pieces and responses, so pieces are kept
+    // small. Returns false once the body is complete. Errors,
+    // `DeadlineExceeded` included, are thrown after the header has gone
+    // out; the connection is then closed.
+    virtual boost::asio::awaitable<bool> next(std::string& out) = 0;
+};
+
+// A response of the request handler. With a `body` stream, `message`
+// only carries the header. Lives in the arena of the request, so it must
+// be gone before the arena.
+struct Response {
+    Response(ResponseMessage message) : message(std::move(message)) {}
+
+    Response(ResponseMessage head, ArenaPtr<BodyStream> body)
+        : message(std::move(head)), body(std::move(body)) {}
+
+    ResponseMessage message;
+    ArenaPtr<BodyStream> body;
+    // The route that handled the request, for metrics.
+    Route route = Route::other;
+};
+
+struct HandlerConfig {
+    // Memory for the serialized averages of completed days. 0 turns the
+    // cache off.
+    size_t avg_cache_bytes;
+    // Time each page of a streamed body after the first may take. The
+    // first page is read before the header, by the request deadline. 0
+    // holds the whole body to the request deadline.
+    std::chrono::milliseconds stream_page_timeout;
+};
+
+HandlerConfig handler_config(const boost::program_options::variables_map& vm);
+
 class RequestHandler {
   public:
-    RequestHandler(Database db);
+    // `stats` is published at /stats/server and /metrics.
+    RequestHandler(std::unique_ptr<Storage> storage, const ServerStats& stats,
+                   const HandlerConfig& config);
     ~RequestHandler();
 
-    http::response<http::string_body>
-    handle_request(const http::request<http::string_body>& req);
+    // `req` must stay alive until the returned coroutine completes. The
+    // response and everything built for it are allocated from `arena`. A
+    // request not answered by `deadline` fails with 504 Gateway Timeout.
+    boost::asio::awaitable<Response> handle_request(const Request& req,
+                                                    RequestArena& arena,
+                                                    Deadline deadline);
 
   private:
     class Impl;
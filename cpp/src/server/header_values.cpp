@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <string_view>
+
+#include "header_values.hpp"
+
+std::string_view trim_whitespace(std::string_view s) {
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) ==
+                      std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+double accept_quality(std::string_view params) {
+    for (;;) {
+        size_t semicolon = params.find(';');
+        if (semicolon == std::string_view::npos) {
+            return 1;
+        }
+        params.remove_prefix(semicolon + 1);
+        std::string_view param =
+            trim_whitespace(params.substr(0, params.find(';')));
+        if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') &&
+            param[1] == '=') {
+            // std::from_chars for double needs a recent libstdc++, and
+            // qvalues have at most three decimals.
+            std::string_view value = param.substr(2);
+            int whole = 0;
+            const char* last = value.data() + value.size();
+            auto [end, ec] = std::from_chars(value.data(), last, whole);
+            if (ec != std::errc()) {
+                return 0;
+            }
+            double q = whole;
+            double scale = 0.1;
+            if (end != last && *end == '.') {
+                for (end++; end != last &&
+                            std::isdigit(static_cast<unsigned char>(*end));
+                     end++) {
+                    q += (*end - '0') * scale;
+                    scale /= 10;
+                }
+            }
+            return q;
+        }
+    }
+}
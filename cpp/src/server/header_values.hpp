@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string_view>
+
+// Helpers for the comma separated values of headers such as `Accept` and
+// `Accept-Encoding`.
+
+// `s` without leading and trailing whitespace.
+std::string_view trim_whitespace(std::string_view s);
+
+// Whether `a` and `b` are equal ignoring ASCII case.
+bool iequals(std::string_view a, std::string_view b);
+
+// Quality of one element such as "gzip;q=0.5": its q parameter, or 1
+// without one.
+double accept_quality(std::string_view element);
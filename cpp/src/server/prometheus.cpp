@@ -0,0 +1,108 @@
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iterator>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "prometheus.hpp"
+
+static double seconds(std::chrono::microseconds us) {
+    return std::chrono::duration<double>(us).count();
+}
+
+void PrometheusWriter::family(std::string_view name, std::string_view type,
+                              std::string_view help) {
+    std::format_to(std::back_inserter(this->out),
+                   "# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+}
+
+void PrometheusWriter::begin_sample(
+    std::string_view name, Labels labels,
+    std::pair<std::string_view, std::string_view> extra) {
+    this->out += name;
+    bool first = true;
+    auto label = [&](std::string_view key, std::string_view value) {
+        this->out += first ? '{' : ',';
+        first = false;
+        this->out += key;
+        this->out += "=\"";
+        for (char c : value) {
+            switch (c) {
+            case '\\':
+                this->out += "\\\\";
+                break;
+            case '"':
+                this->out += "\\\"";
+                break;
+            case '\n':
+                this->out += "\\n";
+                break;
+            default:
+                this->out += c;
+            }
+        }
+        this->out += '"';
+    };
+    for (auto [key, value] : labels) {
+        label(key, value);
+    }
+    if (!extra.first.empty()) {
+        label(extra.first, extra.second);
+    }
+    if (!first) {
+        this->out += '}';
+    }
+    this->out += ' ';
+}
+
+void PrometheusWriter::sample(std::string_view name, Labels labels,
+                              uint64_t value) {
+    this->begin_sample(name, labels);
+    std::format_to(std::back_inserter(this->out), "{}\n", value);
+}
+
+void PrometheusWriter::sample(std::string_view name, Labels labels,
+                              int64_t value) {
+    this->begin_sample(name, labels);
+    std::format_to(std::back_inserter(this->out), "{}\n", value);
+}
+
+void PrometheusWriter::sample(std::string_view name, Labels labels,
+                              double value) {
+    this->begin_sample(name, labels);
+    std::format_to(std::back_inserter(this->out), "{}\n", value);
+}
+
+void PrometheusWriter::histogram(
+    std::string_view name, Labels labels, const LatencyHistogram& histogram,
+    std::span<const std::chrono::microseconds> bounds) {
+    std::string bucket = std::format("{}_bucket", name);
+    std::vector<uint64_t> counts = histogram.cumulative_counts(bounds);
+    for (size_t i = 0; i < bounds.size(); i++) {
+        std::string le = std::format("{}", seconds(bounds[i]));
+        this->begin_sample(bucket, labels, {"le", le});
+        std::format_to(std::back_inserter(this->out), "{}\n", counts[i]);
+    }
+    // Snapshot after the buckets, so +Inf is never below the last bound.
+    LatencyHistogram::Snapshot snapshot = histogram.snapshot();
+    this->begin_sample(bucket, labels, {"le", "+Inf"});
+    std::format_to(std::back_inserter(this->out), "{}\n", snapshot.count);
+    this->sample(std::format("{}_sum", name), labels, seconds(snapshot.sum));
+    this->sample(std::format("{}_count", name), labels, snapshot.count);
+}
+
+void PrometheusWriter::summary(std::string_view name, Labels labels,
+                               const LatencyHistogram::Snapshot& snapshot) {
+    auto quantile = [&](std::string_view q, std::chrono::microseconds value) {
+        this->begin_sample(name, labels, {"quantile", q});
+        std::format_to(std::back_inserter(this->out), "{}\n", seconds(value));
+    };
+    quantile("0.5", snapshot.p50);
+    quantile("0.99", snapshot.p99);
+    quantile("0.999", snapshot.p999);
+    this->sample(std::format("{}_sum", name), labels, seconds(snapshot.sum));
+    this->sample(std::format("{}_count", name), labels, snapshot.count);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "metrics.hpp"
+
+// Builds a page in the Prometheus text exposition format (version 0.0.4).
+class PrometheusWriter {
+  public:
+    using Labels =
+        std::initializer_list<std::pair<std::string_view, std::string_view>>;
+
+    static constexpr const char* content_type =
+        "text/plain; version=0.0.4; charset=utf-8";
+
+    // Starts the metric family `name`; its samples must follow.
+    void family(std::string_view name, std::string_view type,
+                std::string_view help);
+
+    void sample(std::string_view name, Labels labels, uint64_t value);
+
+    void sample(std::string_view name, Labels labels, int64_t value);
+
+    void sample(std::string_view name, Labels labels, double value);
+
+    // Writes the buckets, sum and count of a histogram family `name`
+    // from `histogram`, in seconds.
+    void histogram(std::string_view name, Labels labels,
+                   const LatencyHistogram& histogram,
+                   std::span<const std::chrono::microseconds> bounds);
+
+    // Writes a summary family `name` from a histogram snapshot, in
+    // seconds.
+    void summary(std::string_view name, Labels labels,
+                 const LatencyHistogram::Snapshot& snapshot);
+
+    std::string& str() { return this->out; }
+
+  private:
+    void begin_sample(std::string_view name, Labels labels,
+                      std::pair<std::string_view, std::string_view> extra =
+                          {});
+
+    std::string out;
+};
+
+// Bucket bounds for request latencies, from 1ms to 10s.
+inline constexpr std::chrono::microseconds latency_buckets[] = {
+    std::chrono::milliseconds(1),    std::chrono::microseconds(2500),
+    std::chrono::milliseconds(5),    std::chrono::milliseconds(10),
+    std::chrono::milliseconds(25),   std::chrono::milliseconds(50),
+    std::chrono::milliseconds(100),  std::chrono::milliseconds(250),
+    std::chrono::milliseconds(500),  std::chrono::seconds(1),
+    std::chrono::milliseconds(2500), std::chrono::seconds(5),
+    std::chrono::seconds(10),
+};
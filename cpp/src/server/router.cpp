@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <boost/beast/http/verb.hpp>
+#include <cassandra.h>
+#include <charconv>
+#include <chrono>
+#include <format>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "router.hpp"
+
+// Parses `text` as YYYY-MM-DD.
+static bool parse_date(std::string_view text,
+                       std::chrono::year_month_day& date) {
+    if (text.size() != 10 || text[4] != '-' || text[7] != '-') {
+        return false;
+    }
+    auto number = [&](size_t pos, size_t len, int& value) {
+        const char* first = text.data() + pos;
+        auto [end, ec] = std::from_chars(first, first + len, value);
+        return ec == std::errc() && end == first + len;
+    };
+    int y, m, d;
+    if (!number(0, 4, y) || !number(5, 2, m) || !number(8, 2, d)) {
+        return false;
+    }
+    date = std::chrono::year_month_day{
+        std::chrono::year(y), std::chrono::month(m), std::chrono::day(d)};
+    return date.ok();
+}
+
+// Percent-decodes the path segment `segment`: as is without escapes,
+// into `buffer` otherwise. Empty for a malformed escape or a segment that
+// does not fit.
+static std::optional<std::string_view>
+decode_segment(std::string_view segment, std::span<char> buffer) {
+    if (segment.find('%') == std::string_view::npos) {
+        return segment;
+    }
+    size_t size = 0;
+    for (size_t i = 0; i < segment.size(); i++) {
+        if (size == buffer.size()) {
+            return std::nullopt;
+        }
+        if (segment[i] != '%') {
+            buffer[size++] = segment[i];
+            continue;
+        }
+        if (i + 2 >= segment.size()) {
+            return std::nullopt;
+        }
+        unsigned byte;
+        const char* first = segment.data() + i + 1;
+        auto [end, ec] = std::from_chars(first, first + 2, byte, 16);
+        if (ec != std::errc() || end != first + 2) {
+            return std::nullopt;
+        }
+        buffer[size++] = static_cast<char>(byte);
+        i += 2;
+    }
+    return std::string_view(buffer.data(), size);
+}
+
+static std::string_view method_name(http::verb method) {
+    auto name = http::to_string(method);
+    return {name.data(), name.size()};
+}
+
+Router::Router() : root(std::make_unique<Node>()) {}
+
+Router::~Router() = default;
+
+size_t Router::add(http::verb method, std::string_view pattern) {
+    if (pattern.empty() || pattern.front() != '/') {
+        throw std::invalid_argument(
+            std::format("Route pattern must start with '/': {}", pattern));
+    }
+
+    Node* node = this->root.get();
+    size_t captures = 0;
+    std::string_view rest = pattern.substr(1);
+    for (bool end = false; !end;) {
+        size_t slash = rest.find('/');
+        std::string_view segment = rest.substr(0, slash);
+        end = slash == std::string_view::npos;
+        rest = end ? std::string_view() : rest.substr(slash + 1);
+
+        auto child = std::make_unique<Node>();
+        if (segment.size() > 2 && segment.front() == '{' &&
+            segment.back() == '}') {
+            std::string_view spec = segment.substr(1, segment.size() - 2);
+            size_t colon = spec.find(':');
+            std::string_view type = colon == std::string_view::npos
+                                        ? std::string_view("str")
+                                        : spec.substr(colon + 1);
+            child->name = spec.substr(0, colon);
+            if (type == "uuid") {
+                child->capture = Capture::uuid;
+            } else if (type == "date") {
+                child->capture = Capture::date;
+            } else if (type == "str") {
+                child->capture = Capture::str;
+            } else {
+                throw std::invalid_argument(std::format(
+                    "Unknown capture type '{}' in route {}", type, pattern));
+            }
+            if (++captures > RouteParams::max_captures) {
+                throw std::invalid_argument(
+                    std::format("Too many captures in route {}", pattern));
+            }
+        } else {
+            child->literal = segment;
+        }
+
+        auto same = std::find_if(
+            node->children.begin(), node->children.end(),
+            [&](const std::unique_ptr<Node>& other) {
+                return other->literal == child->literal &&
+                       other->capture == child->capture &&
+                       other->name == child->name;
+            });
+        if (same != node->children.end()) {
+            node = same->get();
+            continue;
+        }
+        // Literals go before captures, so that they are tried first.
+        auto position = node->children.end();
+        if (child->capture == Capture::none) {
+            position = std::find_if(
+                node->children.begin(), node->children.end(),
+                [](const std::unique_ptr<Node>& other) {
+                    return other->capture != Capture::none;
+                });
+        }
+        node = node->children.insert(position, std::move(child))->get();
+    }
+
+    for (auto [other_method, index] : node->routes) {
+        if (other_method == method) {
+            throw std::invalid_argument(
+                std::format("Duplicate route {} {}", method_name(method),
+                            pattern));
+        }
+    }
+    node->routes.emplace_back(method, this->route_count);
+    if (!node->allow.empty()) {
+        node->allow += ", ";
+    }
+    node->allow += method_name(method);
+    return this->route_count++;
+}
+
+Router::Match Router::match(http::verb method, std::string_view target,
+                            RouteParams& params) const {
+    std::string_view path = target.substr(0, target.find('?'));
+    Match best;
+    params.count = 0;
+    if (!path.empty() && path.front() == '/') {
+        this->match(*this->root, path.substr(1), false, method, params, best);
+    }
+    return best;
+}
+
+void Router::match(const Node& node, std::string_view rest, bool end,
+                   http::verb method, RouteParams& params, Match& best) const {
+    if (end) {
+        for (auto [route_method, index] : node.routes) {
+            if (route_method == method) {
+                best.result = Match::found;
+                best.route = index;
+                return;
+            }
+        }
+        if (!node.routes.empty() && best.result != Match::method_not_allowed) {
+            best.result = Match::method_not_allowed;
+            best.allow = node.allow;
+        }
+        return;
+    }
+
+    size_t slash = rest.find('/');
+    bool next_end = slash == std::string_view::npos;
+    std::string_view next =
+        next_end ? std::string_view() : rest.substr(slash + 1);
+    char buffer[RouteParams::max_decoded];
+    std::optional<std::string_view> decoded =
+        decode_segment(rest.substr(0, slash), buffer);
+    if (!decoded) {
+        return;
+    }
+    std::string_view segment = *decoded;
+
+    for (const std::unique_ptr<Node>& child : node.children) {
+        if (child->capture == Capture::none) {
+            if (child->literal == segment) {
+                this->match(*child, next, next_end, method, params, best);
+            }
+        } else {
+            RouteParams::Value& value = params.values[params.count];
+            value.text = segment;
+            if (segment.data() == buffer) {
+                std::copy(segment.begin(), segment.end(),
+                          value.decoded.begin());
+                value.text = std::string_view(value.decoded.data(),
+                                              segment.size());
+            }
+            bool parsed = true;
+            if (child->capture == Capture::uuid) {
+                parsed = cass_uuid_from_string_n(segment.data(), segment.size(),
+                                                 &value.uuid) == CASS_OK;
+            } else if (child->capture == Capture::date) {
+                parsed = parse_date(segment, value.date);
+            }
+            if (!parsed) {
+                if (best.result == Match::not_found &&
+                    this->has_shape(*child, next, next_end)) {
+                    best.result = Match::bad_parameter;
+                    best.parameter = child->name;
+                }
+                continue;
+            }
+            params.count++;
+            this->match(*child, next, next_end, method, params, best);
+            if (best.result != Match::found) {
+                params.count--;
+            }
+        }
+        if (best.result == Match::found) {
+            return;
+        }
+    }
+}
+
+bool Router::has_shape(const Node& node, std::string_view rest,
+                       bool end) const {
+    if (end) {
+        return !node.routes.empty();
+    }
+
+    size_t slash = rest.find('/');
+    bool next_end = slash == std::string_view::npos;
+    std::string_view next =
+        next_end ? std::string_view() : rest.substr(slash + 1);
+    char buffer[RouteParams::max_decoded];
+    std::optional<std::string_view> decoded =
+        decode_segment(rest.substr(0, slash), buffer);
+    if (!decoded) {
+        return false;
+    }
+    std::string_view segment = *decoded;
+
+    for (const std::unique_ptr<Node>& child : node.children) {
+        if ((child->capture != Capture::none || child->literal == segment) &&
+            this->has_shape(*child, next, next_end)) {
+            return true;
+        }
+    }
+    return false;
+}
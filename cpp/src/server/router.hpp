@@ -0,0 +1,137 @@
+#pragma once
+
+#include <array>
+#include <boost/beast/http/verb.hpp>
+#include <cassandra.h>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace http = boost::beast::http;
+
+// Values captured from a request path by `Router::match`, in the order
+// of the captures in the route's pattern.
+class RouteParams {
+  public:
+    static constexpr size_t max_captures = 4;
+
+    // Longest percent-encoded segment, once decoded, that can match.
+    static constexpr size_t max_decoded = 64;
+
+    RouteParams() = default;
+
+    // The captured text may view the params themselves.
+    RouteParams(const RouteParams& other) = delete;
+
+    CassUuid uuid(size_t index) const { return this->values[index].uuid; }
+
+    std::chrono::year_month_day date(size_t index) const {
+        return this->values[index].date;
+    }
+
+    // The captured text, percent-decoded. Views the request target, or
+    // these params for a segment with escapes.
+    std::string_view str(size_t index) const {
+        return this->values[index].text;
+    }
+
+    size_t size() const { return this->count; }
+
+  private:
+    friend class Router;
+
+    struct Value {
+        std::string_view text;
+        CassUuid uuid;
+        std::chrono::year_month_day date;
+        // `text` of a segment with escapes.
+        std::array<char, max_decoded> decoded;
+    };
+
+    std::array<Value, max_captures> values{};
+    size_t count = 0;
+};
+
+// Matches request paths against a set of route patterns, built once at
+// startup into a trie of path segments.
+//
+// A pattern is a path whose segments are literals or typed captures,
+// written `{name:type}`:
+//
+//     /sensors/{sensor_id:uuid}/values/day/{date:date}
+//
+// The types are `uuid`, `date` (YYYY-MM-DD) and `str` (any segment).
+// Captures are parsed while matching, so handlers get typed values and a
+// malformed one is reported by name. Literal segments win over
+// captures. Segments are percent-decoded before they are compared or
+// parsed, as Boost.URL's decoded segments are; a segment with escapes
+// matches only if it decodes to at most `RouteParams::max_decoded`
+// characters, and a malformed escape matches nothing. Matching works on
+// views of the target and stack buffers, and never allocates.
+class Router {
+  public:
+    struct Match {
+        enum Result {
+            found,
+            // No route has this path.
+            not_found,
+            // Routes have this path, but none for this method.
+            method_not_allowed,
+            // A route has the shape of the path, but a capture of it failed
+            // to parse.
+            bad_parameter,
+        };
+
+        Result result = not_found;
+        // With `found`, the index returned by `add`.
+        size_t route = 0;
+        // With `bad_parameter`, the name of the capture.
+        std::string_view parameter;
+        // With `method_not_allowed`, the value of an `Allow` header. Views
+        // the router.
+        std::string_view allow;
+    };
+
+    Router();
+
+    Router(const Router& other) = delete;
+
+    ~Router();
+
+    // Adds a route for `method` and `pattern` and returns its index,
+    // counting from 0. Throws `std::invalid_argument` for a malformed
+    // pattern or a route that is already there.
+    size_t add(http::verb method, std::string_view pattern);
+
+    // Matches the path of `target`, ignoring its query. Captures go into
+    // `params`.
+    Match match(http::verb method, std::string_view target,
+                RouteParams& params) const;
+
+  private:
+    enum class Capture { none, uuid, date, str };
+
+    struct Node {
+        std::string literal;
+        Capture capture = Capture::none;
+        std::string name;
+        std::vector<std::unique_ptr<Node>> children;
+        std::vector<std::pair<http::verb, size_t>> routes;
+        // The methods of `routes`, as an `Allow` header.
+        std::string allow;
+    };
+
+    void match(const Node& node, std::string_view rest, bool end,
+               http::verb method, RouteParams& params, Match& best) const;
+
+    // Whether a route below `node` has the literals of `rest`, whatever
+    // its captures would make of the other segments.
+    bool has_shape(const Node& node, std::string_view rest, bool end) const;
+
+    std::unique_ptr<Node> root;
+    size_t route_count = 0;
+};
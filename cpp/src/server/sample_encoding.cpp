@@ -0,0 +1,230 @@
+#include <array>
+#include <bit>
+#include <cassandra.h>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "header_values.hpp"
+#include "sample_encoding.hpp"
+
+static constexpr std::array sample_formats{
+    SampleFormat::json, SampleFormat::columnar, SampleFormat::cbor};
+
+SampleFormat negotiate_sample_format(std::string_view accept) {
+    // -1 for media ranges the header does not list.
+    std::array<double, sample_formats.size()> listed;
+    listed.fill(-1);
+    double application = -1;
+    double any = -1;
+    while (!accept.empty()) {
+        size_t comma = accept.find(',');
+        std::string_view element = accept.substr(0, comma);
+        accept.remove_prefix(comma == std::string_view::npos ? accept.size()
+                                                             : comma + 1);
+
+        std::string_view type =
+            trim_whitespace(element.substr(0, element.find(';')));
+        double q = accept_quality(element);
+        for (size_t i = 0; i < sample_formats.size(); i++) {
+            if (iequals(type, sample_content_type(sample_formats[i]))) {
+                listed[i] = q;
+            }
+        }
+        if (iequals(type, "application/*")) {
+            application = q;
+        } else if (type == "*/*") {
+            any = q;
+        }
+    }
+
+    // The most specific range that covers a format gives its quality.
+    // Ties go to the earlier format, so wildcards get JSON.
+    SampleFormat best = SampleFormat::json;
+    double best_q = 0;
+    for (size_t i = 0; i < sample_formats.size(); i++) {
+        double q = listed[i] >= 0 ? listed[i]
+                   : application >= 0 ? application
+                                      : any;
+        if (q > best_q) {
+            best = sample_formats[i];
+            best_q = q;
+        }
+    }
+    return best;
+}
+
+std::string_view sample_content_type(SampleFormat format) {
+    switch (format) {
+    case SampleFormat::columnar:
+        return "application/vnd.carepet.columnar";
+    case SampleFormat::cbor:
+        return "application/cbor";
+    case SampleFormat::json:
+        break;
+    }
+    return "application/json";
+}
+
+std::string_view sample_format_name(SampleFormat format) {
+    switch (format) {
+    case SampleFormat::columnar:
+        return "columnar";
+    case SampleFormat::cbor:
+        return "cbor";
+    case SampleFormat::json:
+        break;
+    }
+    return "json";
+}
+
+// Writes the bytes of `value` at `p`, least significant first.
+template <typename T> static void store_le(char* p, T value) {
+    auto bits = static_cast<std::make_unsigned_t<T>>(value);
+    for (size_t i = 0; i < sizeof(T); i++) {
+        p[i] = static_cast<char>(bits >> (8 * i));
+    }
+}
+
+// Writes the bytes of `value` at `p`, most significant first.
+template <typename T> static void store_be(char* p, T value) {
+    auto bits = static_cast<std::make_unsigned_t<T>>(value);
+    for (size_t i = 0; i < sizeof(T); i++) {
+        p[i] = static_cast<char>(bits >> (8 * (sizeof(T) - 1 - i)));
+    }
+}
+
+// The 16 bytes of `uuid` in the order of its string form.
+static void append_uuid(std::string& out, CassUuid uuid) {
+    char bytes[16];
+    store_be(bytes, static_cast<uint32_t>(uuid.time_and_version));
+    store_be(bytes + 4, static_cast<uint16_t>(uuid.time_and_version >> 32));
+    store_be(bytes + 6, static_cast<uint16_t>(uuid.time_and_version >> 48));
+    store_be(bytes + 8, uuid.clock_seq_and_node);
+    out.append(bytes, sizeof(bytes));
+}
+
+class ColumnarEncoder : public SampleEncoder {
+  public:
+    explicit ColumnarEncoder(CassUuid sensor_id) : sensor_id(sensor_id) {}
+
+    void begin(std::string& out) override {
+        out.append("CPMC\x01\0\0\0", 8);
+        append_uuid(out, this->sensor_id);
+    }
+
+    void page(std::span<const Sample> samples, std::string& out) override {
+        if (samples.empty()) {
+            return;
+        }
+        size_t n = samples.size();
+        size_t padding = n % 2 == 0 ? 0 : 4;
+        size_t at = out.size();
+        out.resize(at + 8 + n * 12 + padding);
+        char* p = out.data() + at;
+
+        store_le<uint64_t>(p, n);
+        p += 8;
+        for (const Sample& sample : samples) {
+            // Unsigned, so that extreme timestamps wrap instead of
+            // overflowing.
+            store_le<uint64_t>(p, uint64_t(sample.ts) - uint64_t(this->last));
+            this->last = sample.ts;
+            p += 8;
+        }
+        for (const Sample& sample : samples) {
+            store_le(p, std::bit_cast<uint32_t>(sample.value));
+            p += 4;
+        }
+        std::memset(p, 0, padding);
+    }
+
+    void end(std::string& out) override { out.append(8, '\0'); }
+
+  private:
+    CassUuid sensor_id;
+    // Timestamp of the last sample encoded.
+    cass_int64_t last = 0;
+};
+
+// Appends the head of a CBOR data item of major type `major` with
+// argument `value`.
+static void append_cbor_head(std::string& out, uint8_t major,
+                             uint64_t value) {
+    char head[9];
+    head[0] = static_cast<char>(major << 5);
+    size_t size = 1;
+    if (value < 24) {
+        head[0] |= static_cast<char>(value);
+    } else if (value <= 0xff) {
+        head[0] |= 24;
+        head[1] = static_cast<char>(value);
+        size = 2;
+    } else if (value <= 0xffff) {
+        head[0] |= 25;
+        store_be(head + 1, static_cast<uint16_t>(value));
+        size = 3;
+    } else if (value <= 0xffffffff) {
+        head[0] |= 26;
+        store_be(head + 1, static_cast<uint32_t>(value));
+        size = 5;
+    } else {
+        head[0] |= 27;
+        store_be(head + 1, value);
+        size = 9;
+    }
+    out.append(head, size);
+}
+
+static void append_cbor_text(std::string& out, std::string_view text) {
+    append_cbor_head(out, 3, text.size());
+    out.append(text);
+}
+
+class CborEncoder : public SampleEncoder {
+  public:
+    explicit CborEncoder(CassUuid sensor_id) : sensor_id(sensor_id) {}
+
+    void begin(std::string& out) override {
+        append_cbor_head(out, 5, 2);
+        append_cbor_text(out, "sensor_id");
+        append_cbor_head(out, 6, 37);
+        append_cbor_head(out, 2, 16);
+        append_uuid(out, this->sensor_id);
+        append_cbor_text(out, "measurements");
+        out.push_back('\x9f');
+    }
+
+    void page(std::span<const Sample> samples, std::string& out) override {
+        for (const Sample& sample : samples) {
+            out.push_back('\x82');
+            if (sample.ts >= 0) {
+                append_cbor_head(out, 0, uint64_t(sample.ts));
+            } else {
+                append_cbor_head(out, 1, ~uint64_t(sample.ts));
+            }
+            char value[5] = {'\xfa'};
+            store_be(value + 1, std::bit_cast<uint32_t>(sample.value));
+            out.append(value, sizeof(value));
+        }
+    }
+
+    void end(std::string& out) override { out.push_back('\xff'); }
+
+  private:
+    CassUuid sensor_id;
+};
+
+ArenaPtr<SampleEncoder> columnar_encoder(CassUuid sensor_id,
+                                         std::pmr::memory_resource* memory) {
+    return arena_new<ColumnarEncoder>(memory, sensor_id);
+}
+
+ArenaPtr<SampleEncoder> cbor_encoder(CassUuid sensor_id,
+                                     std::pmr::memory_resource* memory) {
+    return arena_new<CborEncoder>(memory, sensor_id);
+}
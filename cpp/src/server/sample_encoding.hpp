@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cassandra.h>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "arena.hpp"
+#include "storage.hpp"
+
+// Representations of the measurements of a sensor.
+enum class SampleFormat {
+    json,
+    // application/vnd.carepet.columnar, see `columnar_encoder`.
+    columnar,
+    // application/cbor, see `cbor_encoder`.
+    cbor,
+};
+
+// Picks the format of measurements from the request's `Accept` header.
+// JSON unless the client prefers one of the binary formats.
+SampleFormat negotiate_sample_format(std::string_view accept);
+
+std::string_view sample_content_type(SampleFormat format);
+
+// Short name of `format`, for entity tags.
+std::string_view sample_format_name(SampleFormat format);
+
+// Encodes the measurements of one sensor into a body, a run of samples
+// at a time.
+class SampleEncoder {
+  public:
+    virtual ~SampleEncoder() = default;
+
+    // Appends what comes before the first sample.
+    virtual void begin(std::string& out) = 0;
+
+    virtual void page(std::span<const Sample> samples, std::string& out) = 0;
+
+    // Appends what comes after the last sample.
+    virtual void end(std::string& out) = 0;
+};
+
+// Columnar encoding, all integers little-endian:
+//
+// - a 24-byte header: the magic "CPMC", a version byte (1), three zero
+//   bytes and the sensor id as the 16 bytes of RFC 9562;
+// - blocks of a few hundred samples at most: a uint64 count n, n int64
+//   timestamps in milliseconds, each the difference to the one before
+//   (the first of the body is relative to 0), n float32 values, and 4
+//   zero bytes if n is odd;
+// - a block with a count of 0.
+//
+// Every block and column starts 8-byte aligned, so a client can view
+// the columns of a body in memory as arrays without parsing them. The
+// encoder lives in `memory`.
+ArenaPtr<SampleEncoder> columnar_encoder(CassUuid sensor_id,
+                                         std::pmr::memory_resource* memory);
+
+// CBOR (RFC 8949) encoding: a map of "sensor_id", a UUID (tag 37), and
+// "measurements", an indefinite-length array of [ts, value] arrays with
+// `ts` an integer in milliseconds and `value` a single-precision float.
+// The encoder lives in `memory`.
+ArenaPtr<SampleEncoder> cbor_encoder(CassUuid sensor_id,
+                                     std::pmr::memory_resource* memory);
@@ -13,20 +13,41 @@
 //
 //------------------------------------------------------------------------------
 
-#include <boost/asio/dispatch.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/signal_set.hpp>
 #include <boost/asio/strand.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/http/string_body.hpp>
 #include <boost/beast/version.hpp>
 #include <boost/config.hpp>
+#include <algorithm>
+#include <atomic>
 #include <cassandra.h>
+#include <chrono>
+#include <cstring>
+#include <format>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <vector>
 
-#include "database.hpp"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "admission.hpp"
+#include "caching_storage.hpp"
+#include "arena.hpp"
+#include "compression.hpp"
 #include "handlers.hpp"
+#include "server_stats.hpp"
+#include "storage.hpp"
 
 namespace beast = boost::beast;
 namespace http = beast::http;
@@ -38,72 +59,335 @@ void fail(beast::error_code ec, char const* what) {
     std::cerr << what << ": " << ec.message() << "\n";
 }
 
-// Helper function to send an HTTP message
+// Report an exception that escaped a coroutine
+void fail(std::exception_ptr e, char const* what) {
+    if (!e) {
+        return;
+    }
+    try {
+        std::rethrow_exception(e);
+    } catch (std::exception const& ex) {
+        std::cerr << what << ": " << ex.what() << "\n";
+    } catch (...) {
+        std::cerr << what << ": unknown exception\n";
+    }
+}
+
+// Helper function to send an HTTP message. Returns the bytes written.
 template <class Stream, bool isRequest, class Body, class Fields>
-void send_message(Stream& stream, bool& close, beast::error_code& ec,
-                  http::message<isRequest, Body, Fields>&& msg) {
+net::awaitable<size_t>
+send_message(Stream& stream, bool& close, beast::error_code& ec,
+             http::message<isRequest, Body, Fields>&& msg) {
     // Determine if we should close the connection after
     close = msg.need_eof();
 
     // We need the serializer here because the serializer requires
     // a non-const file_body, and the message oriented version of
-    // http::write only works with const messages.
+    // http::async_write only works with const messages.
     http::serializer<isRequest, Body, Fields> sr{msg};
-    http::write(stream, sr, ec);
+    co_return co_await http::async_write(
+        stream, sr, net::redirect_error(net::use_awaitable, ec));
+}
+
+// State shared by the listener and the sessions of one shard.
+struct Shard {
+    // Shard `index` of `shards`. The limits are split evenly between them.
+    Shard(RequestHandler& handler, const ServerLimits& limits,
+          const CompressionConfig& compression, ServerStats& server_stats,
+          size_t index, size_t shards)
+        : handler(handler), limits(limits), compression(compression),
+          admission(share(limits.max_connections, shards),
+                    share(limits.max_requests, shards),
+                    share(limits.queue_size, shards)),
+          server_stats(server_stats), stats(server_stats.shard(index)),
+          arenas(share(limits.max_requests, shards)) {}
+
+    static size_t share(size_t limit, size_t shards) {
+        return limit / shards + (limit % shards != 0);
+    }
+
+    RequestHandler& handler;
+    const ServerLimits& limits;
+    const CompressionConfig& compression;
+    AdmissionControl admission;
+    ServerStats& server_stats;
+    ShardStats& stats;
+    // Buffers of the arenas of requests. Keeps as many as the shard may
+    // handle requests at once, so that a burst up to that limit does not
+    // allocate them again.
+    ArenaPool arenas;
+};
+
+// Response to a request shed by admission control.
+ResponseMessage service_unavailable(unsigned version, bool keep_alive,
+                                    std::chrono::seconds retry_after) {
+    ResponseMessage res{http::status::service_unavailable, version};
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(http::field::content_type, "text/html");
+    res.set(http::field::retry_after, std::to_string(retry_after.count()));
+    res.keep_alive(keep_alive);
+    res.body() = "Server overloaded, retry later";
+    res.prepare_payload();
+    return res;
+}
+
+// Admits `req` and hands it to the request handler, or sheds it. The
+// request's slot is kept in `ticket`.
+net::awaitable<Response> respond(const Request& req, RequestArena& arena,
+                                 Shard& shard,
+                                 AdmissionControl::Ticket& ticket) {
+    // Time spent waiting for admission counts against the deadline.
+    Deadline deadline =
+        std::chrono::steady_clock::now() + shard.limits.request_deadline;
+    bool queued = false;
+    ticket = co_await shard.admission.admit(deadline, queued);
+    if (queued) {
+        shard.stats.queued_requests.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!ticket) {
+        shard.stats.shed_requests.fetch_add(1, std::memory_order_relaxed);
+        co_return service_unavailable(req.version(), req.keep_alive(),
+                                      shard.limits.retry_after);
+    }
+
+    try {
+        co_return co_await shard.handler.handle_request(req, arena, deadline);
+    } catch (std::exception const& e) {
+        ResponseMessage res{http::status::internal_server_error,
+                            req.version()};
+        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(http::field::content_type, "text/html");
+        res.keep_alive(req.keep_alive());
+        res.body() = std::format(
+            "Internal error (unhandled exception thrown): {}", e.what());
+        res.prepare_payload();
+        co_return res;
+    } catch (...) {
+        ResponseMessage res{http::status::internal_server_error,
+                            req.version()};
+        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(http::field::content_type, "text/html");
+        res.keep_alive(req.keep_alive());
+        res.body() = "Internal server error - unknown unhandled exception ";
+        res.prepare_payload();
+        co_return res;
+    }
+}
+
+// Sends the header `head`, then the pieces of `body` as they are
+// produced: as chunks to HTTP/1.1 clients, and until the connection
+// closes to HTTP/1.0 ones. Pieces are compressed with `encoding`, if
+// any, and flushed one by one so the client can decode them right away.
+// Only one piece is held in memory at a time, in `piece` and `compressed`,
+// which the connection keeps so that their memory serves all its streams.
+// Returns the bytes written.
+net::awaitable<size_t> send_stream(beast::tcp_stream& stream, bool& close,
+                                 beast::error_code& ec, ResponseMessage&& head,
+                                 BodyStream& body,
+                                 std::optional<ContentEncoding> encoding,
+                                 std::string& piece, std::string& compressed,
+                                 const Shard& shard) {
+    http::response<http::empty_body, ArenaFields> res{std::move(head.base())};
+    if (res.version() >= 11) {
+        res.chunked(true);
+    } else {
+        res.keep_alive(false);
+    }
+    std::optional<Deflater> deflater;
+    if (encoding) {
+        res.set(http::field::content_encoding,
+                *encoding == ContentEncoding::gzip ? "gzip" : "deflate");
+        deflater.emplace(*encoding, shard.compression.level);
+        tag_encoding(res.base(), *encoding);
+    }
+    close = res.need_eof();
+
+    http::response_serializer<http::empty_body, ArenaFields> sr{res};
+    stream.expires_after(shard.limits.write_timeout);
+    size_t written = co_await http::async_write_header(
+        stream, sr, net::redirect_error(net::use_awaitable, ec));
+    if (ec) {
+        co_return written;
+    }
+
+    for (bool more = true; more;) {
+        piece.clear();
+        more = co_await body.next(piece);
+        std::string_view data = piece;
+        if (deflater) {
+            compressed.clear();
+            deflater->compress(piece, more ? Z_SYNC_FLUSH : Z_FINISH,
+                               compressed);
+            data = compressed;
+        }
+        // An empty chunk would end the body.
+        if (data.empty()) {
+            continue;
+        }
+
+        stream.expires_after(shard.limits.write_timeout);
+        if (res.chunked()) {
+            written += co_await net::async_write(
+                stream, http::make_chunk(net::buffer(data)),
+                net::redirect_error(net::use_awaitable, ec));
+        } else {
+            written += co_await net::async_write(
+                stream, net::buffer(data),
+                net::redirect_error(net::use_awaitable, ec));
+        }
+        if (ec) {
+            co_return written;
+        }
+    }
+
+    if (res.chunked()) {
+        stream.expires_after(shard.limits.write_timeout);
+        written += co_await net::async_write(
+            stream, http::make_chunk_last(),
+            net::redirect_error(net::use_awaitable, ec));
+    }
+    co_return written;
 }
 
-// Handles an HTTP server connection
-void do_session(beast::tcp_stream& stream, RequestHandler& rh) {
+// Handles an HTTP server connection. The session runs on its own strand
+// and gives its thread back to the pool whenever it waits for the client
+// or for the database.
+net::awaitable<void> do_session(beast::tcp_stream stream, Shard& shard) {
+    // Gives the connection slot back however the session ends.
+    struct ConnectionSlot {
+        ~ConnectionSlot() {
+            shard.admission.close_connection();
+            shard.stats.open_connections.fetch_sub(1,
+                                                   std::memory_order_relaxed);
+        }
+        Shard& shard;
+    } slot{shard};
+    shard.stats.open_connections.fetch_add(1, std::memory_order_relaxed);
+
+    const ServerLimits& limits = shard.limits;
     bool close = false;
     beast::error_code ec;
 
     // This buffer is required to persist across reads
     beast::flat_buffer buffer;
 
+    // Pieces of streamed bodies, before and after compression.
+    std::string piece;
+    std::string compressed;
+
     for (;;) {
+        // A keep-alive connection may stay silent for the idle timeout.
+        // Once the next request has started it must arrive in full
+        // within the read timeout. On timeout the stream closes the
+        // socket.
+        if (buffer.size() == 0) {
+            stream.expires_after(limits.idle_timeout);
+            size_t n = co_await stream.async_read_some(
+                buffer.prepare(4096),
+                net::redirect_error(net::use_awaitable, ec));
+            buffer.commit(n);
+            if (ec == net::error::eof) {
+                break;
+            }
+            if (ec == beast::error::timeout) {
+                shard.stats.timed_out_connections.fetch_add(
+                    1, std::memory_order_relaxed);
+                co_return;
+            }
+            if (ec) {
+                co_return fail(ec, "read");
+            }
+        }
+
+        // Memory of the request being served. Only taken from the pool
+        // once the request has started, so that idle connections hold no
+        // buffer, and given back when the iteration ends with the response
+        // written. Declared before the request and response so that it
+        // outlives them.
+        RequestArena arena(shard.arenas, shard.stats.arena_heap_blocks);
+
         // Read a request
-        http::request<http::string_body> req;
-        http::read(stream, buffer, req, ec);
+        stream.expires_after(limits.read_timeout);
+        Request req{std::piecewise_construct,
+                    std::make_tuple(arena.resource()),
+                    std::make_tuple(arena.resource())};
+        size_t bytes_in = co_await http::async_read(
+            stream, buffer, req, net::redirect_error(net::use_awaitable, ec));
         if (ec == http::error::end_of_stream) {
             break;
         }
+        if (ec == beast::error::timeout) {
+            shard.stats.timed_out_connections.fetch_add(
+                1, std::memory_order_relaxed);
+            co_return;
+        }
 
         if (ec) {
-            return fail(ec, "read");
-        }
-
-        // Send the response
-        http::response<http::string_body> response;
-        try {
-            response = rh.handle_request(req);
-        } catch (std::exception const& e) {
-            http::response<http::string_body> res{
-                http::status::internal_server_error, req.version()};
-            res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-            res.set(http::field::content_type, "text/html");
-            res.keep_alive(req.keep_alive());
-            res.body() = std::format(
-                "Internal error (unhandled exception thrown): {}", e.what());
-            res.prepare_payload();
-            response = res;
-        } catch (...) {
-            http::response<http::string_body> res{
-                http::status::internal_server_error, req.version()};
-            res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
-            res.set(http::field::content_type, "text/html");
-            res.keep_alive(req.keep_alive());
-            res.body() = "Internal server error - unknown unhandled exception ";
-            res.prepare_payload();
-            response = res;
-        }
-
-        // Send the response using the helper function
-        send_message(stream, close, ec, std::move(response));
+            co_return fail(ec, "read");
+        }
+
+        shard.stats.requests.fetch_add(1, std::memory_order_relaxed);
+        auto started = std::chrono::steady_clock::now();
+        struct InFlight {
+            ~InFlight() {
+                stats.in_flight_requests.fetch_sub(1,
+                                                   std::memory_order_relaxed);
+            }
+            ShardStats& stats;
+        } in_flight{shard.stats};
+        shard.stats.in_flight_requests.fetch_add(1, std::memory_order_relaxed);
+
+        AdmissionControl::Ticket ticket;
+        Response response = co_await respond(req, arena, shard, ticket);
+        std::optional<ContentEncoding> encoding = choose_encoding(
+            req, response.message, response.body != nullptr, shard.compression);
+        unsigned status = response.message.result_int();
+        size_t bytes_out = 0;
+
+        if (response.body) {
+            // The body is still being read, so the request keeps its slot
+            // until it is sent. The header is out by the time the body can
+            // fail; all that is left to do is to drop the connection.
+            try {
+                bytes_out = co_await send_stream(stream, close, ec,
+                                                 std::move(response.message),
+                                                 *response.body, encoding,
+                                                 piece, compressed, shard);
+            } catch (...) {
+                co_return fail(std::current_exception(), "stream");
+            }
+        } else {
+            ticket = {};
+
+            // Send the response using the helper function
+            stream.expires_after(limits.write_timeout);
+            if (encoding) {
+                bytes_out = co_await send_message(
+                    stream, close, ec,
+                    compress(std::move(response.message), *encoding,
+                             shard.compression.level));
+            } else {
+                bytes_out = co_await send_message(stream, close, ec,
+                                                  std::move(response.message));
+            }
+        }
+
+        if (ec == beast::error::timeout) {
+            shard.stats.timed_out_connections.fetch_add(
+                1, std::memory_order_relaxed);
+            co_return;
+        }
 
         if (ec) {
-            return fail(ec, "write");
+            co_return fail(ec, "write");
         }
 
+        shard.server_stats.route(response.route)
+            .record(status,
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - started),
+                    bytes_in, bytes_out);
+
         if (close) {
             // This means we should close the connection, usually because
             // the response indicated the "Connection: close" semantic.
@@ -118,60 +402,229 @@ void do_session(beast::tcp_stream& stream, RequestHandler& rh) {
     // At this point the connection is closed gracefully
 }
 
-// Accepts incoming connections and launches the sessions
-void do_listen(net::io_context& ioc, tcp::endpoint endpoint,
-               RequestHandler& rh) {
+// Answers a connection over `--max-connections` with 503 and closes it
+// without reading its request.
+net::awaitable<void> reject_connection(beast::tcp_stream stream,
+                                       const ServerLimits& limits) {
+    beast::error_code ec;
+    stream.expires_after(limits.write_timeout);
+    co_await http::async_write(
+        stream, service_unavailable(11, false, limits.retry_after),
+        net::redirect_error(net::use_awaitable, ec));
+    beast::error_code ignored =
+        stream.socket().shutdown(tcp::socket::shutdown_send, ec);
+}
+
+#ifdef SO_REUSEPORT
+using reuse_port =
+    net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
+// Accepts incoming connections and launches the sessions. A `sharded`
+// listener binds with SO_REUSEPORT next to the listeners of the other
+// shards and runs its sessions directly on its single-threaded `ioc`.
+net::awaitable<void> do_listen(net::io_context& ioc, tcp::endpoint endpoint,
+                               Shard& shard, bool sharded) {
     beast::error_code ec;
 
     // Open the acceptor
     tcp::acceptor acceptor(ioc);
 
     if (acceptor.open(endpoint.protocol(), ec)) {
-        return fail(ec, "open");
+        co_return fail(ec, "open");
     }
 
     // Allow address reuse
     if (acceptor.set_option(net::socket_base::reuse_address(true), ec)) {
-        return fail(ec, "set_option");
+        co_return fail(ec, "set_option");
+    }
+#ifdef SO_REUSEPORT
+    // Lets the kernel spread incoming connections over the shards.
+    if (sharded && acceptor.set_option(reuse_port(true), ec)) {
+        co_return fail(ec, "set_option");
     }
+#endif
 
     // Bind to the server address
     if (acceptor.bind(endpoint, ec)) {
-        return fail(ec, "bind");
+        co_return fail(ec, "bind");
     }
 
     // Start listening for connections
     if (acceptor.listen(net::socket_base::max_listen_connections, ec)) {
-        return fail(ec, "listen");
+        co_return fail(ec, "listen");
     }
 
     for (;;) {
-        tcp::socket socket{ioc};
-        if (acceptor.accept(socket, ec)) {
+        // In the shared pool every connection gets its own strand, so its
+        // handlers never run concurrently even though the io_context is
+        // served by many threads. A shard runs on one thread only.
+        net::any_io_executor executor = ioc.get_executor();
+        if (!sharded) {
+            executor = net::make_strand(ioc);
+        }
+        tcp::socket socket(executor);
+        co_await acceptor.async_accept(
+            socket, net::redirect_error(net::use_awaitable, ec));
+        if (ec) {
             fail(ec, "accept");
             continue;
         }
+        shard.stats.accepted.fetch_add(1, std::memory_order_relaxed);
+
+        if (!shard.admission.open_connection()) {
+            shard.stats.rejected_connections.fetch_add(
+                1, std::memory_order_relaxed);
+            net::co_spawn(executor,
+                          reject_connection(
+                              beast::tcp_stream(std::move(socket)),
+                              shard.limits),
+                          [](std::exception_ptr e) { fail(e, "reject"); });
+            continue;
+        }
 
         // Launch the session, transferring ownership of the socket
-        std::thread{[](beast::tcp_stream stream, RequestHandler& rh) {
-                        do_session(stream, rh);
-                    },
-                    beast::tcp_stream(std::move(socket)), std::ref(rh)}
-            .detach();
+        net::co_spawn(executor,
+                      do_session(beast::tcp_stream(std::move(socket)), shard),
+                      [](std::exception_ptr e) { fail(e, "session"); });
     }
 }
 
-void run_server(const boost::program_options::variables_map& vm) {
-    auto const address = net::ip::make_address(vm["host"].as<std::string>());
-    auto const port = vm["port"].as<unsigned short>();
+// Binds the calling thread to `cpu`.
+static void pin_to_cpu(unsigned cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+        std::cerr << std::format("Failed to pin thread to CPU {}: {}\n", cpu,
+                                 std::strerror(err));
+    }
+#else
+    std::cerr << "CPU pinning is not supported on this platform\n";
+#endif
+}
 
-    Database db(vm);
-    RequestHandler rh(std::move(db));
+// One io_context served by a pool of `threads` threads and a single
+// acceptor.
+static void run_pooled(tcp::endpoint endpoint, int threads, RequestHandler& rh,
+                       const ServerLimits& limits,
+                       const CompressionConfig& compression,
+                       ServerStats& stats) {
+    Shard shard(rh, limits, compression, stats, 0, 1);
 
     // The io_context is required for all I/O
-    net::io_context ioc{};
+    net::io_context ioc{threads};
 
     // Create and launch a listening port
-    std::cout << "Server listening on " << address << ":" << port << std::endl;
-    do_listen(ioc, tcp::endpoint{address, port}, rh);
+    std::cout << "Server listening on " << endpoint << " with " << threads
+              << " threads" << std::endl;
+    net::co_spawn(ioc, do_listen(ioc, endpoint, shard, false),
+                  [&ioc](std::exception_ptr e) {
+                      fail(e, "listen");
+                      ioc.stop();
+                  });
+
+    // Capture SIGINT and SIGTERM to perform a clean shutdown
+    net::signal_set signals(ioc, SIGINT, SIGTERM);
+    signals.async_wait([&ioc](beast::error_code const&, int) { ioc.stop(); });
+
+    // Run the I/O service on the requested number of threads
+    std::vector<std::thread> v;
+    v.reserve(threads - 1);
+    for (auto i = threads - 1; i > 0; --i) {
+        v.emplace_back([&ioc] { ioc.run(); });
+    }
+    ioc.run();
+
+    // Block until all the threads exit
+    for (auto& t : v) {
+        t.join();
+    }
+}
+
+// `shards` single-threaded io_contexts, each with its own SO_REUSEPORT
+// acceptor and sessions. Requests never cross shards; only the storage
+// backend is shared.
+static void run_sharded(tcp::endpoint endpoint, int shards, bool pin_cpus,
+                        RequestHandler& rh, const ServerLimits& limits,
+                        const CompressionConfig& compression,
+                        ServerStats& stats) {
+#ifndef SO_REUSEPORT
+    throw std::runtime_error("--shards needs SO_REUSEPORT support");
+#endif
+    std::vector<std::unique_ptr<net::io_context>> contexts;
+    std::vector<std::unique_ptr<Shard>> state;
+    for (int i = 0; i < shards; i++) {
+        // A concurrency hint of 1 lets asio skip internal locking.
+        contexts.push_back(std::make_unique<net::io_context>(1));
+        state.push_back(
+            std::make_unique<Shard>(rh, limits, compression, stats, i, shards));
+    }
+    auto stop_all = [&contexts] {
+        for (auto& ioc : contexts) {
+            ioc->stop();
+        }
+    };
+
+    std::cout << "Server listening on " << endpoint << " with " << shards
+              << " shards" << std::endl;
+    for (int i = 0; i < shards; i++) {
+        net::io_context& ioc = *contexts[i];
+        net::co_spawn(ioc, do_listen(ioc, endpoint, *state[i], true),
+                      [stop_all](std::exception_ptr e) {
+                          fail(e, "listen");
+                          stop_all();
+                      });
+    }
+
+    // Capture SIGINT and SIGTERM to perform a clean shutdown
+    net::signal_set signals(*contexts[0], SIGINT, SIGTERM);
+    signals.async_wait(
+        [stop_all](beast::error_code const&, int) { stop_all(); });
+
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> v;
+    v.reserve(shards);
+    for (int i = 0; i < shards; i++) {
+        v.emplace_back([&contexts, i, pin_cpus, cpus] {
+            if (pin_cpus) {
+                pin_to_cpu(i % cpus);
+            }
+            contexts[i]->run();
+        });
+    }
+    for (auto& t : v) {
+        t.join();
+    }
+
+    for (int i = 0; i < shards; i++) {
+        const ShardStats& shard = stats.shard(i);
+        std::cout << std::format(
+            "Shard {}: {} connections ({} rejected), {} requests ({} shed)\n",
+            i, shard.accepted.load(), shard.rejected_connections.load(),
+            shard.requests.load(), shard.shed_requests.load());
+    }
+}
+
+void run_server(const boost::program_options::variables_map& vm) {
+    auto const address = net::ip::make_address(vm["host"].as<std::string>());
+    auto const port = vm["port"].as<unsigned short>();
+    auto const threads = std::max(1, vm["threads"].as<int>());
+    auto const shards = std::max(0, vm["shards"].as<int>());
+    ServerLimits const limits = server_limits(vm);
+    CompressionConfig const compression = compression_config(vm);
+
+    ServerStats stats(std::max(1, shards));
+    RequestHandler rh(cache_metadata(make_storage(vm), vm), stats,
+                      handler_config(vm));
+
+    if (shards > 0) {
+        run_sharded(tcp::endpoint{address, port}, shards,
+                    vm["pin-cpus"].as<bool>(), rh, limits, compression, stats);
+    } else {
+        run_pooled(tcp::endpoint{address, port}, threads, rh, limits,
+                   compression, stats);
+    }
 }
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "metrics.hpp"
+
+// Counters of one shard of the HTTP server, written by the threads that
+// serve the shard. With `--shards` those are the shard's own threads, so
+// the counters stay on their cores; without it every pool thread writes
+// the one shard.
+struct alignas(64) ShardStats {
+    std::atomic<uint64_t> accepted{0};
+    // Connections closed right away because of `--max-connections`.
+    std::atomic<uint64_t> rejected_connections{0};
+    // Connections closed by the idle, read or write timeout.
+    std::atomic<uint64_t> timed_out_connections{0};
+    std::atomic<uint64_t> requests{0};
+    // Requests that waited for a free request slot.
+    std::atomic<uint64_t> queued_requests{0};
+    // Requests answered with 503 by admission control.
+    std::atomic<uint64_t> shed_requests{0};
+    // Blocks that request arenas took from the heap after outgrowing
+    // their buffer.
+    std::atomic<uint64_t> arena_heap_blocks{0};
+    // Gauges.
+    std::atomic<int64_t> open_connections{0};
+    std::atomic<int64_t> in_flight_requests{0};
+};
+
+// Routes of the REST API, as reported in metrics.
+enum class Route {
+    owner,
+    pets,
+    sensors,
+    pet_measurements,
+    measurements,
+    sensor_avg,
+    statement_stats,
+    server_stats,
+    metrics,
+    // Anything that matched no route.
+    other,
+    count,
+};
+
+inline constexpr size_t route_count = size_t(Route::count);
+
+inline constexpr std::array<std::string_view, route_count> route_names{
+    "/owner/{id}",
+    "/owner/{id}/pets",
+    "/pet/{id}/sensors",
+    "/pet/{id}/values",
+    "/sensors/{id}/values",
+    "/sensors/{id}/values/day/{date}",
+    "/stats/statements",
+    "/stats/server",
+    "/metrics",
+    "other",
+};
+
+// Metrics of one route. Shared by all shards, but every counter is
+// sharded per thread, so recording never contends.
+struct RouteMetrics {
+    // Records one response with HTTP status `status`. `latency` runs from
+    // the end of the request to the end of the response.
+    void record(unsigned status, std::chrono::microseconds latency,
+                uint64_t bytes_in, uint64_t bytes_out) {
+        size_t status_class = status / 100;
+        if (status_class >= 1 && status_class <= this->responses.size()) {
+            this->responses[status_class - 1].add(1);
+        }
+        this->latency.record(latency);
+        this->bytes_in.add(bytes_in);
+        this->bytes_out.add(bytes_out);
+    }
+
+    // Responses by status class, 1xx to 5xx.
+    std::array<ShardedCounter, 5> responses;
+    LatencyHistogram latency;
+    ShardedCounter bytes_in;
+    ShardedCounter bytes_out;
+};
+
+// Counters of the HTTP server, one set per shard, plus metrics per route.
+// Without `--shards` the whole thread pool counts as a single shard.
+class ServerStats {
+  public:
+    explicit ServerStats(size_t shards) : shards(shards) {}
+
+    ServerStats(const ServerStats& other) = delete;
+
+    ShardStats& shard(size_t index) { return this->shards[index]; }
+
+    const ShardStats& shard(size_t index) const { return this->shards[index]; }
+
+    size_t shard_count() const { return this->shards.size(); }
+
+    RouteMetrics& route(Route route) { return this->routes[size_t(route)]; }
+
+    const RouteMetrics& route(Route route) const {
+        return this->routes[size_t(route)];
+    }
+
+  private:
+    std::vector<ShardStats> shards;
+    std::array<RouteMetrics, route_count> routes;
+};
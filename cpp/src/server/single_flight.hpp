@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "deadline.hpp"
+
+// Coalesces concurrent computations of the same key: the first caller
+// computes, callers that arrive while it runs wait for its result, on
+// whichever executor they run. Results are not kept once handed out.
+// Thread safe.
+template <typename Key, typename Value, typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>>
+class SingleFlight {
+  public:
+    SingleFlight() = default;
+
+    SingleFlight(const SingleFlight& other) = delete;
+
+    // Returns the result of `compute()`, an awaitable of `Value`, or of
+    // the computation of `key` already in flight, in which case `joined`
+    // is set. Errors of the computation are thrown to every caller that
+    // waited for it, except those caused by the deadline of the caller
+    // that computed: `DeadlineExceeded`, or any error thrown once that
+    // deadline has passed. The deadline is not the waiters', so one of
+    // them with time left computes again instead. A waiter whose own
+    // `deadline` passes first gets `DeadlineExceeded`.
+    template <typename Compute>
+    boost::asio::awaitable<Value> run(const Key& key, Deadline deadline,
+                                      Compute compute, bool& joined) {
+        namespace net = boost::asio;
+
+        auto executor = co_await net::this_coro::executor;
+        for (;;) {
+            std::shared_ptr<Flight> flight;
+            std::shared_ptr<net::steady_timer> timer;
+            {
+                std::lock_guard lock(this->mutex);
+                auto [it, inserted] = this->flights.try_emplace(key);
+                if (inserted) {
+                    it->second = std::make_shared<Flight>();
+                } else {
+                    timer = std::make_shared<net::steady_timer>(executor,
+                                                                deadline);
+                    it->second->waiters.push_back(timer);
+                }
+                flight = it->second;
+            }
+
+            if (!timer) {
+                std::optional<Value> value;
+                std::exception_ptr error;
+                bool timed_out = false;
+                try {
+                    value.emplace(co_await compute());
+                } catch (const DeadlineExceeded&) {
+                    error = std::current_exception();
+                    timed_out = true;
+                } catch (...) {
+                    error = std::current_exception();
+                    // Likely a query that ran out of this caller's time.
+                    timed_out = std::chrono::steady_clock::now() >= deadline;
+                }
+                this->finish(key, *flight, value, error, timed_out);
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+                co_return std::move(*value);
+            }
+
+            // Woken up early by `finish`.
+            boost::system::error_code ec;
+            co_await timer->async_wait(
+                net::redirect_error(net::use_awaitable, ec));
+
+            std::lock_guard lock(this->mutex);
+            if (!flight->done) {
+                std::erase(flight->waiters, timer);
+                throw DeadlineExceeded();
+            }
+            if (flight->timed_out) {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    throw DeadlineExceeded();
+                }
+                // The first waiter back starts the next computation.
+                continue;
+            }
+            joined = true;
+            if (flight->error) {
+                std::rethrow_exception(flight->error);
+            }
+            co_return *flight->value;
+        }
+    }
+
+  private:
+    struct Flight {
+        bool done = false;
+        // The computation failed because its caller ran out of time, so
+        // `error` is not handed out.
+        bool timed_out = false;
+        std::optional<Value> value;
+        std::exception_ptr error;
+        std::vector<std::shared_ptr<boost::asio::steady_timer>> waiters;
+    };
+
+    // Publishes the outcome of `flight` and wakes its waiters. Callers
+    // arriving afterwards start a new computation.
+    void finish(const Key& key, Flight& flight,
+                const std::optional<Value>& value, std::exception_ptr error,
+                bool timed_out) {
+        std::lock_guard lock(this->mutex);
+        flight.done = true;
+        flight.value = value;
+        flight.error = error;
+        flight.timed_out = timed_out;
+        for (auto& timer : flight.waiters) {
+            boost::asio::post(timer->get_executor(),
+                              [timer] { timer->cancel(); });
+        }
+        flight.waiters.clear();
+        this->flights.erase(key);
+    }
+
+    std::mutex mutex;
+    std::unordered_map<Key, std::shared_ptr<Flight>, Hash, Equal> flights;
+};